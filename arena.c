@@ -0,0 +1,192 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <expat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * Size of a regular chunk.
+ * Allocations larger than a quarter of this get a chunk of their own so
+ * that we don't waste the remainder of the current one.
+ */
+#define	ARENA_CHUNK	(64 * 1024)
+
+/*
+ * Alignment of arena_malloc() allocations.
+ * This is enough for the pointer and integer arrays we keep.
+ */
+#define	ARENA_ALIGN	8
+
+struct	achunk {
+	struct achunk	*next; /* next in list */
+	size_t		 sz; /* usable size of data */
+	size_t		 pos; /* bytes used in data */
+	/* data follows */
+};
+
+/*
+ * A bump allocator owning all memory of a set of articles.
+ * Nothing is freed individually: arena_free() releases all chunks at
+ * once.
+ * An arena is not thread-safe: each parse worker has its own, merged
+ * with arena_merge() once the workers have finished.
+ */
+struct	arena {
+	struct achunk	*head; /* current chunk and list head */
+};
+
+#define	CHUNK_HEAD \
+	((sizeof(struct achunk) + ARENA_ALIGN - 1) & \
+	 ~(size_t)(ARENA_ALIGN - 1))
+#define	CHUNK_DATA(_c) \
+	((char *)(_c) + CHUNK_HEAD)
+
+static struct achunk *
+achunk_alloc(size_t sz)
+{
+	struct achunk	*c;
+
+	c = xmalloc(CHUNK_HEAD + sz);
+	c->next = NULL;
+	c->sz = sz;
+	c->pos = 0;
+	return(c);
+}
+
+struct arena *
+arena_alloc(void)
+{
+
+	return(xcalloc(1, sizeof(struct arena)));
+}
+
+/*
+ * Free all memory in the arena "a", which may be NULL.
+ */
+void
+arena_free(struct arena *a)
+{
+	struct achunk	*c;
+
+	if (NULL == a)
+		return;
+
+	while (NULL != (c = a->head)) {
+		a->head = c->next;
+		free(c);
+	}
+
+	free(a);
+}
+
+/*
+ * Move all of the memory in "src" into "dst", then free "src".
+ * Pointers into "src" remain valid.
+ */
+void
+arena_merge(struct arena *dst, struct arena *src)
+{
+	struct achunk	*c;
+
+	if (NULL == src || dst == src)
+		return;
+
+	if (NULL == dst->head) {
+		dst->head = src->head;
+	} else if (NULL != src->head) {
+		/* Keep our current chunk at the head. */
+		for (c = src->head; NULL != c->next; c = c->next)
+			continue;
+		c->next = dst->head->next;
+		dst->head->next = src->head;
+	}
+
+	src->head = NULL;
+	arena_free(src);
+}
+
+static void *
+arena_get(struct arena *a, size_t sz, size_t align)
+{
+	struct achunk	*c;
+	size_t		 pos;
+
+	if (NULL != (c = a->head)) {
+		pos = (c->pos + align - 1) & ~(align - 1);
+		if (pos <= c->sz && c->sz - pos >= sz) {
+			c->pos = pos + sz;
+			return(CHUNK_DATA(c) + pos);
+		}
+	}
+
+	if (sz > ARENA_CHUNK / 4) {
+		c = achunk_alloc(sz);
+		c->pos = sz;
+		if (NULL == a->head)
+			a->head = c;
+		else {
+			c->next = a->head->next;
+			a->head->next = c;
+		}
+		return(CHUNK_DATA(c));
+	}
+
+	c = achunk_alloc(ARENA_CHUNK);
+	c->next = a->head;
+	c->pos = sz;
+	a->head = c;
+	return(CHUNK_DATA(c));
+}
+
+/*
+ * Allocate "sz" bytes of uninitialised, aligned memory.
+ */
+void *
+arena_malloc(struct arena *a, size_t sz)
+{
+
+	return(arena_get(a, sz, ARENA_ALIGN));
+}
+
+/*
+ * Like strndup(3) into the arena: copy at most "sz" bytes of "cp" and
+ * nil-terminate.
+ */
+char *
+arena_strndup(struct arena *a, const char *cp, size_t sz)
+{
+	char	*p;
+
+	sz = strnlen(cp, sz);
+	p = arena_get(a, sz + 1, 1);
+	memcpy(p, cp, sz);
+	p[sz] = '\0';
+	return(p);
+}
+
+char *
+arena_strdup(struct arena *a, const char *cp)
+{
+
+	return(arena_strndup(a, cp, strlen(cp)));
+}
@@ -23,45 +23,18 @@
 
 #include "extern.h"
 
-static void
-article_free(struct article *p)
-{
-	size_t	 i;
-
-	if (NULL == p) 
-		return;
-
-	free(p->img);
-	free(p->base);
-	free(p->stripbase);
-	free(p->striplangbase);
-	free(p->title);
-	free(p->titletext);
-	free(p->author);
-	free(p->authortext);
-	free(p->aside);
-	free(p->asidetext);
-	free(p->article);
-
-	for (i = 0; i < p->tagmapsz; i++)
-		free(p->tagmap[i]);
-	for (i = 0; i < p->setmapsz; i++)
-		free(p->setmap[i]);
-
-	free(p->tagmap);
-	free(p->setmap);
-}
-
+/*
+ * Free the articles "p" of length "sz" as returned by sblg_parse().
+ * All of the article contents are owned by a single arena, so we need
+ * only release that and the array itself.
+ */
 void
 sblg_free(struct article *p, size_t sz)
 {
-	size_t	 i;
 
 	if (NULL == p)
 		return;
-
-	for (i = 0; i < sz; i++)
-		article_free(&p[i]);
-
+	if (sz > 0)
+		arena_free(p[0].arena);
 	free(p);
 }
@@ -33,22 +33,23 @@
 #include "extern.h"
 
 struct	atom {
-	FILE		*f;
+	struct out	*f;
 	const char	*src;
 	const char	*dst;
 	XML_Parser	 p;
 	char		 domain[MAXHOSTNAMELEN];
 	char		 path[MAXPATHLEN];
-	struct article	*sargs;
+	const struct article *sargs;
+	struct artset	*set; /* set of sargs */
+	const size_t	*sperm; /* order of sargs */
 	size_t		 spos;
 	size_t		 sposz;
 	int		 hasid;
 	size_t		 stack;
 };
 
-static	void	atomprint(FILE *f, const struct atom *arg, 
-			int altlink, int striplink, int content, 
-			const struct article *src);
+static	void	atomprint(struct out *f, const struct atom *arg, 
+			int altlink, int striplink, int content, size_t idx);
 static	void	entry_begin(void *userdata, const XML_Char *name, 
 			const XML_Char **atts);
 static	void	entry_empty(void *userdata, const XML_Char *name);
@@ -66,113 +67,112 @@ static	void	up_begin(void *userdata, const XML_Char *name,
 static	void	up_end(void *userdata, const XML_Char *name);
 
 static void
-atomputs(FILE *f, const char *cp)
+atomputs(struct out *f, const char *cp)
 {
+	size_t	 sz, n;
 	
-	for ( ; '\0' != *cp; cp++)
+	for (sz = strlen(cp); sz > 0; cp++, sz--) {
+		n = escspan(cp, sz, "<>\"&");
+		out_write(f, cp, n);
+		if (0 == (sz -= n))
+			break;
+		cp += n;
 		switch (*cp) {
 		case ('<'):
-			fputs("&lt;", f);
+			out_write(f, "&lt;", 4);
 			break;
 		case ('>'):
-			fputs("&gt;", f);
+			out_write(f, "&gt;", 4);
 			break;
 		case ('"'):
-			fputs("&quot;", f);
-			break;
-		case ('&'):
-			fputs("&amp;", f);
+			out_write(f, "&quot;", 6);
 			break;
 		default:
-			fputc(*cp, f);
+			out_write(f, "&amp;", 5);
 			break;
 		}
+	}
 }
 
 static void
-atomprint(FILE *f, const struct atom *arg, int altlink, 
-	int striplink, int content, const struct article *src)
+atomprint(struct out *f, const struct atom *arg, int altlink, 
+	int striplink, int content, size_t idx)
 {
-	char		 buf[1024];
-	struct tm	*tm;
-
-	tm = gmtime(&src->time);
-
-	strftime(buf, sizeof(buf), "%F", tm);
-	fprintf(f, "<id>tag:%s,%s:%s/%s</id>\n", 
-		arg->domain, buf, arg->path, src->src);
-
-	strftime(buf, sizeof(buf), "%FT%TZ", tm);
-	fprintf(f, "<updated>%s</updated>\n", buf);
-
-	fprintf(f, "<title>%s</title>\n", src->titletext);
-	fprintf(f, "<author><name>%s</name></author>\n", src->authortext);
-	if (altlink && ! striplink)
-		fprintf(f, "<link rel=\"alternate\" type=\"text/html\" "
-			 "href=\"%s/%s\" />\n", arg->path, src->src);
-	else if (altlink)
-		fprintf(f, "<link rel=\"alternate\" type=\"text/html\" "
-			 "href=\"%s/%s\" />\n", arg->path, src->stripsrc);
+	const struct article *src = &arg->sargs[idx];
+	const struct artdate *d;
+
+	d = artset_date(arg->set, idx);
+
+	out_puts(f, "<id>tag:");
+	out_puts(f, arg->domain);
+	out_putc(f, ',');
+	out_puts(f, d->date);
+	out_putc(f, ':');
+	out_puts(f, arg->path);
+	out_putc(f, '/');
+	out_puts(f, src->src);
+	out_puts(f, "</id>\n");
+
+	out_puts(f, "<updated>");
+	out_puts(f, d->datetime);
+	out_puts(f, "</updated>\n");
+
+	out_puts(f, "<title>");
+	if (NULL != src->titletext)
+		out_puts(f, src->titletext);
+	out_puts(f, "</title>\n");
+	out_puts(f, "<author><name>");
+	if (NULL != src->authortext)
+		out_puts(f, src->authortext);
+	out_puts(f, "</name></author>\n");
+
+	if (altlink) {
+		out_puts(f, "<link rel=\"alternate\" "
+			"type=\"text/html\" href=\"");
+		out_puts(f, arg->path);
+		out_putc(f, '/');
+		out_puts(f, striplink ? src->stripsrc : src->src);
+		out_puts(f, "\" />\n");
+	}
 
-	if (content && NULL != src->article) {
-		fprintf(f, "<content type=\"html\">");
+	out_puts(f, "<content type=\"html\">");
+	if (content && NULL != src->article)
 		atomputs(f, src->article);
-		fprintf(f, "</content>");
-	} else {
-		fprintf(f, "<content type=\"html\">");
+	else
 		atomputs(f, src->aside);
-		fprintf(f, "</content>");
-	}
+	out_puts(f, "</content>");
 }
 
+/*
+ * Fill the Atom template "templ" with the articles in "set" in order
+ * "asort", writing to "f" for the output file "dst".
+ * Returns zero on failure.
+ */
 int
-atom(XML_Parser p, const char *templ, int sz, 
-	char *src[], const char *dst, enum asort asort)
+atom_exec(XML_Parser p, const char *templ, struct artset *set, 
+	struct out *f, const char *dst, enum asort asort)
 {
-	char		*buf;
-	size_t		 ssz, sargsz;
-	int		 i, fd, rc;
-	FILE		*f;
+	struct input	 in;
+	int		 c, rc = 0;
 	struct atom	 larg;
-	struct article	*sargs;
 
-	ssz = 0;
-	rc = 0;
-	buf = NULL;
-	fd = -1;
-	f = NULL;
+	memset(&in, 0, sizeof(struct input));
+	in.fd = -1;
 
 	memset(&larg, 0, sizeof(struct atom));
-	sargs = NULL;
-	sargsz = 0;
 
 	getdomainname(larg.domain, MAXHOSTNAMELEN);
 	if ('\0' == larg.domain[0])
 		strlcpy(larg.domain, "localhost", MAXHOSTNAMELEN);
 	strlcpy(larg.path, "/", MAXPATHLEN);
 
-	for (i = 0; i < sz; i++)
-		if ( ! sblg_parse(p, src[i], &sargs, &sargsz))
-			goto out;
-
-	if (ASORT_DATE == asort)
-		qsort(sargs, sargsz, sizeof(struct article), datecmp);
-	else if (ASORT_RDATE == asort)
-		qsort(sargs, sargsz, sizeof(struct article), rdatecmp);
-	else if (ASORT_FILENAME == asort)
-		qsort(sargs, sargsz, sizeof(struct article), filenamecmp);
-
-	f = stdout;
-	if (strcmp(dst, "-") && NULL == (f = fopen(dst, "w"))) {
-		warn("%s", dst);
-		goto out;
-	}
-
-	if ( ! mmap_open(templ, &fd, &buf, &ssz))
+	if ( ! input_open(&in, templ))
 		goto out;
 
-	larg.sargs = sargs;
-	larg.sposz = sargsz;
+	larg.sargs = set->arts;
+	larg.set = set;
+	larg.sperm = artset_order(set, asort);
+	larg.sposz = set->artsz;
 	larg.p = p;
 	larg.src = templ;
 	larg.dst = dst;
@@ -183,21 +183,53 @@ atom(XML_Parser p, const char *templ, int sz,
 	XML_SetElementHandler(p, tmpl_begin, tmpl_end);
 	XML_SetUserData(p, &larg);
 
-	if (XML_STATUS_OK != XML_Parse(p, buf, (int)ssz, 1)) {
-		warnx("%s:%zu:%zu: %s", templ, 
-			XML_GetCurrentLineNumber(p),
-			XML_GetCurrentColumnNumber(p),
-			XML_ErrorString(XML_GetErrorCode(p)));
+	if ((c = input_parse(&in, p)) <= 0) {
+		if (0 == c)
+			warnx("%s:%zu:%zu: %s", templ, 
+				XML_GetCurrentLineNumber(p),
+				XML_GetCurrentColumnNumber(p),
+				XML_ErrorString(XML_GetErrorCode(p)));
 		goto out;
 	} 
 
-	fputc('\n', f);
+	out_putc(f, '\n');
 	rc = 1;
 out:
+	input_close(&in);
+	return(rc);
+}
+
+int
+atom(XML_Parser p, const struct popts *po, const char *templ, 
+	int sz, char *src[], const char *dst, enum asort asort)
+{
+	size_t		 sargsz;
+	int		 rc;
+	struct out	*f;
+	struct article	*sargs;
+	struct artset	 set;
+
+	rc = 0;
+	f = NULL;
+
+	sargs = NULL;
+	sargsz = 0;
+	artset_init(&set, NULL, 0);
+
+	if ( ! sblg_parse_all(p, po, sz, src, &sargs, &sargsz))
+		goto out;
+
+	artset_init(&set, sargs, sargsz);
+
+	if (NULL == (f = out_open(dst)))
+		goto out;
+
+	rc = atom_exec(p, templ, &set, f, dst, asort);
+out:
+	artset_free(&set);
 	sblg_free(sargs, sargsz);
-	mmap_close(fd, buf, ssz);
-	if (NULL != f && stdout != f)
-		fclose(f);
+	if ( ! out_close(f))
+		rc = 0;
 	return(rc);
 }
 
@@ -206,7 +238,7 @@ tmpl_text(void *userdata, const XML_Char *s, int len)
 {
 	struct atom	*arg = userdata;
 
-	fprintf(arg->f, "%.*s", len, s);
+	out_write(arg->f, s, len);
 }
 
 static void
@@ -246,7 +278,7 @@ tmpl_begin(void *userdata,
 	int		  altlink, content, striplink;
 	const char	 *start;
 	char		 *cp;
-	struct tm	 *tm;
+	struct tm	  tm;
 	const XML_Char	**attp;
 
 	assert(0 == arg->stack);
@@ -259,13 +291,15 @@ tmpl_begin(void *userdata,
 			xmlopens(arg->f, name, atts);
 			return;
 		}
-		fprintf(arg->f, "<%s>", name);
+		out_putc(arg->f, '<');
+		out_puts(arg->f, name);
+		out_putc(arg->f, '>');
 		t = arg->sposz <= arg->spos ?
 			time(NULL) :
-			arg->sargs[arg->spos].time;
-		tm = localtime(&t);
-		strftime(buf, sizeof(buf), "%FT%TZ", tm);
-		fprintf(arg->f, "%s", buf);
+			arg->sargs[arg->sperm[arg->spos]].time;
+		localtime_r(&t, &tm);
+		strftime(buf, sizeof(buf), "%FT%TZ", &tm);
+		out_puts(arg->f, buf);
 		arg->stack++;
 		XML_SetDefaultHandlerExpand(arg->p, NULL);
 		XML_SetElementHandler(arg->p, up_begin, up_end);
@@ -278,7 +312,9 @@ tmpl_begin(void *userdata,
 			xmlopens(arg->f, name, atts);
 			return;
 		}
-		fprintf(arg->f, "<%s>", name);
+		out_putc(arg->f, '<');
+		out_puts(arg->f, name);
+		out_putc(arg->f, '>');
 		arg->stack++;
 		XML_SetDefaultHandlerExpand(arg->p, NULL);
 		XML_SetElementHandler(arg->p, id_begin, id_end);
@@ -353,11 +389,13 @@ tmpl_begin(void *userdata,
 	arg->stack++;
 	XML_SetDefaultHandlerExpand(arg->p, NULL);
 	if (arg->sposz > arg->spos) {
-		fprintf(arg->f, "<%s>", name);
+		out_putc(arg->f, '<');
+		out_puts(arg->f, name);
+		out_putc(arg->f, '>');
 		XML_SetDefaultHandlerExpand(arg->p, NULL);
 		XML_SetElementHandler(arg->p, entry_begin, entry_end);
 		atomprint(arg->f, arg, altlink, striplink,
-			content, &arg->sargs[arg->spos++]);
+			content, arg->sperm[arg->spos++]);
 	} else {
 		XML_SetElementHandler(arg->p, entry_begin, entry_empty);
 	}
@@ -388,8 +426,15 @@ id_end(void *userdata, const XML_Char *name)
 	struct atom	*arg = userdata;
 
 	if (0 == strcasecmp(name, "id") && 0 == --arg->stack) {
-		fprintf(arg->f, "tag:%s,2013:%s/%s</%s>", 
-			arg->domain, arg->path, arg->dst, name);
+		out_puts(arg->f, "tag:");
+		out_puts(arg->f, arg->domain);
+		out_puts(arg->f, ",2013:");
+		out_puts(arg->f, arg->path);
+		out_putc(arg->f, '/');
+		out_puts(arg->f, arg->dst);
+		out_write(arg->f, "</", 2);
+		out_puts(arg->f, name);
+		out_putc(arg->f, '>');
 		XML_SetElementHandler(arg->p, tmpl_begin, tmpl_end);
 		XML_SetDefaultHandlerExpand(arg->p, tmpl_text);
 	}
@@ -401,7 +446,9 @@ up_end(void *userdata, const XML_Char *name)
 	struct atom	*arg = userdata;
 
 	if (0 == strcasecmp(name, "updated") && 0 == --arg->stack) {
-		fprintf(arg->f, "</%s>", name);
+		out_write(arg->f, "</", 2);
+		out_puts(arg->f, name);
+		out_putc(arg->f, '>');
 		XML_SetElementHandler(arg->p, tmpl_begin, tmpl_end);
 		XML_SetDefaultHandlerExpand(arg->p, tmpl_text);
 	}
@@ -413,7 +460,9 @@ entry_end(void *userdata, const XML_Char *name)
 	struct atom	*arg = userdata;
 
 	if (0 == strcasecmp(name, "entry") && 0 ==  --arg->stack) {
-		fprintf(arg->f, "</%s>", name);
+		out_write(arg->f, "</", 2);
+		out_puts(arg->f, name);
+		out_putc(arg->f, '>');
 		XML_SetElementHandler(arg->p, tmpl_begin, tmpl_end);
 		XML_SetDefaultHandlerExpand(arg->p, tmpl_text);
 	}
@@ -0,0 +1,527 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <errno.h>
+#include <expat.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * Building several targets (see target_parse()) from one parse of the
+ * input files.
+ * Each target has one or more outputs (pages, for TGT_PAGES and
+ * TGT_INDEX), each of which is rendered in turn by workers taking them
+ * from a shared list.
+ */
+
+/*
+ * A target being built with its compiled template, if any.
+ */
+struct	btarget {
+	const struct target *tg; /* the target */
+	struct tmpl	*t; /* TGT_BLOG, TGT_PAGES, TGT_INDEX template */
+	char		**dsts; /* pages or NULL (see linkall_dsts()) */
+	size_t		 dstsz; /* number of pages */
+	size_t		*starts; /* TGT_INDEX first article of pages */
+	struct page	*pages; /* TGT_INDEX pages */
+};
+
+/*
+ * An output to render: a target's only output or one of its pages.
+ */
+struct	bitem {
+	struct btarget	*bt; /* target */
+	size_t		 page; /* position of page */
+};
+
+/*
+ * Outputs being rendered by build(), shared by its workers.
+ */
+struct	bjob {
+	struct artset	*set; /* articles (shared) */
+	enum asort	 asort; /* order of articles */
+	struct bitem	*items; /* outputs to render */
+	size_t		 itemsz; /* number of outputs */
+	size_t		 next; /* next output to take */
+	int		 failed; /* whether any output failed */
+	pthread_mutex_t	 mutex; /* guards next and failed */
+	struct writer	*writer; /* outputs or NULL to write here */
+	struct stage	*rst; /* renderer statistics or NULL */
+	struct stage	*wst; /* writer statistics or NULL */
+};
+
+/*
+ * Parse the -T argument "spec" into "tg".
+ * This is "mode:template:output", where the mode is empty for the blog
+ * amalgamation or the flags of another mode ("a", "j", "l" with any of
+ * "j" and "r", "L", or "P") and the template and output are optional.
+ * For "L", the output is the directory of pages as for -d; for "P", it's
+ * the first page (see build_index()).
+ * Returns zero if malformed (having reported it).
+ */
+int
+target_parse(struct target *tg, const char *spec)
+{
+	char	*mode, *templ, *dst;
+	int	 a = 0, j = 0, l = 0, L = 0, P = 0, r = 0;
+	size_t	 i;
+
+	memset(tg, 0, sizeof(struct target));
+	tg->buf = mode = xstrdup(spec);
+
+	templ = dst = NULL;
+	if (NULL != (templ = strchr(mode, ':'))) {
+		*templ++ = '\0';
+		if (NULL != (dst = strchr(templ, ':')))
+			*dst++ = '\0';
+	}
+
+	for (i = 0; '\0' != mode[i]; i++)
+		switch (mode[i]) {
+		case ('a'):
+			a = 1;
+			break;
+		case ('j'):
+			j = 1;
+			break;
+		case ('l'):
+			l = 1;
+			break;
+		case ('L'):
+			L = 1;
+			break;
+		case ('P'):
+			P = 1;
+			break;
+		case ('r'):
+			r = 1;
+			break;
+		default:
+			goto bad;
+		}
+
+	if (l) {
+		if (a || L || P)
+			goto bad;
+		tg->mode = TGT_TAGS;
+		tg->json = j;
+		tg->rev = r;
+	} else if (r || a + j + L + P > 1)
+		goto bad;
+	else if (a)
+		tg->mode = TGT_ATOM;
+	else if (j)
+		tg->mode = TGT_JSON;
+	else if (L)
+		tg->mode = TGT_PAGES;
+	else if (P)
+		tg->mode = TGT_INDEX;
+	else
+		tg->mode = TGT_BLOG;
+
+	if (NULL != templ && '\0' != *templ)
+		tg->templ = templ;
+	if (NULL != dst && '\0' != *dst)
+		tg->dst = dst;
+
+	switch (tg->mode) {
+	case (TGT_ATOM):
+		if (NULL == tg->templ)
+			tg->templ = "atom-template.xml";
+		if (NULL == tg->dst)
+			tg->dst = "atom.xml";
+		break;
+	case (TGT_JSON):
+		tg->templ = NULL;
+		if (NULL == tg->dst)
+			tg->dst = "blog.json";
+		break;
+	case (TGT_TAGS):
+		tg->templ = NULL;
+		if (NULL == tg->dst)
+			tg->dst = "-";
+		break;
+	case (TGT_PAGES):
+		if (NULL == tg->templ)
+			tg->templ = "blog-template.xml";
+		break;
+	default:
+		if (NULL == tg->templ)
+			tg->templ = "blog-template.xml";
+		if (NULL == tg->dst)
+			tg->dst = "blog.html";
+		break;
+	}
+
+	return(1);
+bad:
+	warnx("%s: malformed target", spec);
+	free(tg->buf);
+	tg->buf = NULL;
+	return(0);
+}
+
+void
+target_free(struct target *tg)
+{
+
+	free(tg->buf);
+}
+
+/*
+ * Divide the articles of "set" in order "asort" into the pages of the
+ * TGT_INDEX target "bt", each continuing where the article slots of its
+ * template left off on the page before, and name them (see pagename()).
+ * There is always a first page, even if it has no articles.
+ * Returns zero if the target can't be paginated (having reported it).
+ */
+static int
+build_index(struct btarget *bt, struct artset *set, enum asort asort)
+{
+	const char	*dst = bt->tg->dst, *cp;
+	size_t		 i, pos = 0, next, shown;
+
+	if (0 == strcmp(dst, "-")) {
+		warnx("%s: cannot paginate to standard output", dst);
+		return(0);
+	}
+
+	do {
+		next = tmpl_page(bt->t, set, asort, pos, &shown);
+		if (shown > 0 || 0 == bt->dstsz) {
+			bt->starts = xreallocarray(bt->starts, 
+				bt->dstsz + 1, sizeof(size_t));
+			bt->starts[bt->dstsz++] = pos;
+		}
+		pos = next;
+	} while (shown > 0);
+
+	/* Pages link to each other by name: they share a directory. */
+
+	bt->dsts = xcalloc(bt->dstsz, sizeof(char *));
+	bt->pages = xcalloc(bt->dstsz, sizeof(struct page));
+	for (i = 0; i < bt->dstsz; i++) {
+		bt->dsts[i] = pagename(dst, i + 1);
+		bt->pages[i].num = i + 1;
+		bt->pages[i].max = bt->dstsz;
+	}
+	for (i = 0; i < bt->dstsz; i++) {
+		cp = strrchr(bt->dsts[i], '/');
+		cp = NULL == cp ? bt->dsts[i] : cp + 1;
+		if (i > 0)
+			bt->pages[i - 1].next = cp;
+		if (i + 1 < bt->dstsz)
+			bt->pages[i + 1].prev = cp;
+	}
+
+	return(1);
+}
+
+/*
+ * Render the output "it" into memory (see out_mem()).
+ * Returns the output for the caller to close or NULL on failure.
+ */
+static struct out *
+build_render(struct bjob *job, XML_Parser p, const struct bitem *it)
+{
+	const struct btarget *bt = it->bt;
+	const struct target *tg = bt->tg;
+	struct out	*f;
+
+	if (TGT_PAGES == tg->mode)
+		return(linkall_page(bt->t, job->set, 
+			job->asort, bt->dsts, it->page, tg->dst));
+
+	if (TGT_INDEX == tg->mode) {
+		f = out_mem(bt->dsts[it->page]);
+		tmpl_exec(bt->t, f, bt->dsts[it->page], job->set, 
+			job->asort, bt->starts[it->page], 
+			job->set->artsz, 0, &bt->pages[it->page]);
+		out_putc(f, '\n');
+		return(f);
+	}
+
+	f = out_mem(tg->dst);
+
+	switch (tg->mode) {
+	case (TGT_ATOM):
+		if (atom_exec(p, tg->templ, 
+		    job->set, f, tg->dst, job->asort))
+			break;
+		out_close(f);
+		return(NULL);
+	case (TGT_JSON):
+		json_exec(f, job->set, job->asort);
+		break;
+	case (TGT_TAGS):
+		listtags_exec(f, job->set, tg->json, tg->rev);
+		break;
+	default:
+		tmpl_exec(bt->t, f, strcmp(tg->dst, "-") ? 
+			tg->dst : NULL, job->set, job->asort, 
+			0, job->set->artsz, 0, NULL);
+		out_putc(f, '\n');
+		break;
+	}
+
+	return(f);
+}
+
+/*
+ * Take outputs one at a time until none are left, rendering each then
+ * passing it to the writer (or, if there is none, writing it here).
+ */
+static void *
+build_worker(void *dat)
+{
+	struct bjob	*job = dat;
+	struct out	*f;
+	XML_Parser	 p;
+	size_t		 i, items = 0;
+	int		 rc;
+	double		 start, t, wait = 0.0, wbusy = 0.0;
+
+	start = stage_time();
+	if (NULL == (p = XML_ParserCreate(NULL)))
+		err(EXIT_FAILURE, "XML_ParserCreate");
+
+	for (;;) {
+		pthread_mutex_lock(&job->mutex);
+		i = job->next++;
+		pthread_mutex_unlock(&job->mutex);
+
+		if (i >= job->itemsz)
+			break;
+
+		items++;
+		f = build_render(job, p, &job->items[i]);
+
+		if (NULL != f && NULL != job->writer) {
+			writer_put(job->writer, f, &wait);
+			continue;
+		} else if (NULL != f) {
+			t = stage_time();
+			rc = out_close(f);
+			wbusy += stage_time() - t;
+			if (rc)
+				continue;
+		}
+
+		pthread_mutex_lock(&job->mutex);
+		job->failed = 1;
+		pthread_mutex_unlock(&job->mutex);
+	}
+
+	XML_ParserFree(p);
+	if (NULL != job->writer)
+		writer_done(job->writer);
+	else
+		stage_add(job->wst, items, wbusy, 0.0);
+	stage_add(job->rst, items, 
+		stage_time() - start - wait - wbusy, wait);
+	return(NULL);
+}
+
+/*
+ * Build the "tgsz" targets "tgs" from the input files "src", parsed
+ * only once and shared by all.
+ * Outputs are rendered by up to "jobs" threads (see struct popts), and
+ * with more than one, written by another as they're rendered.
+ * An output that fails is reported on its own without stopping the rest.
+ * Returns zero if any failed.
+ */
+int
+build(XML_Parser p, const struct popts *po, const struct target *tgs,
+	size_t tgsz, int sz, char *src[], enum asort asort)
+{
+	struct btarget	*bts;
+	struct article	*sargs = NULL;
+	size_t		 sargsz = 0, i, j, nthreads;
+	int		 er, rc = 0, bodies = 0;
+	struct artset	 set;
+	struct popts	 mpo;
+	struct bjob	 job;
+	struct stage	*pst = NULL, *rst = NULL, *wst = NULL;
+	pthread_t	*threads;
+	double		 start, wall;
+
+	memset(&job, 0, sizeof(struct bjob));
+	artset_init(&set, NULL, 0);
+	bts = xcalloc(tgsz, sizeof(struct btarget));
+
+	/*
+	 * Compile the templates once for all outputs.
+	 * This tells us whether we need article bodies at all: the
+	 * Atom and JSON outputs always do.
+	 */
+
+	for (i = 0; i < tgsz; i++) {
+		bts[i].tg = &tgs[i];
+		switch (tgs[i].mode) {
+		case (TGT_BLOG):
+			bts[i].t = tmpl_compile(p, 
+				tgs[i].templ, TMPL_LINKALL);
+			break;
+		case (TGT_INDEX):
+			bts[i].t = tmpl_compile(p, 
+				tgs[i].templ, TMPL_INDEX);
+			break;
+		case (TGT_PAGES):
+			bts[i].t = tmpl_compile(p, 
+				tgs[i].templ, TMPL_LINKALL_SINGLE);
+			break;
+		case (TGT_ATOM):
+		case (TGT_JSON):
+			bodies = 1;
+			continue;
+		default:
+			continue;
+		}
+		if (NULL == bts[i].t)
+			goto out;
+		if (tmpl_slots(bts[i].t) > 0)
+			bodies = 1;
+	}
+
+	if (po->stats) {
+		pst = stage_alloc("parse");
+		rst = stage_alloc("render");
+		wst = stage_alloc("write");
+	}
+
+	mpo = *po;
+	if ( ! bodies)
+		mpo.body = PBODY_NONE;
+
+	start = stage_time();
+	if ( ! sblg_parse_all(p, &mpo, sz, src, &sargs, &sargsz))
+		goto out;
+	stage_add(pst, (size_t)sz, stage_time() - start, 0.0);
+
+	/* 
+	 * Compute everything the outputs would compute lazily, so that
+	 * they may share the articles.
+	 * Then list the outputs, pages after the rest.
+	 */
+
+	artset_init(&set, sargs, sargsz);
+	artset_order(&set, asort);
+
+	job.items = xcalloc(tgsz, sizeof(struct bitem));
+	for (i = 0; i < tgsz; i++) {
+		if (NULL != bts[i].t)
+			tmpl_prepare(bts[i].t, &set, asort);
+		if (TGT_TAGS == tgs[i].mode)
+			artset_tagsz(&set);
+		if (TGT_PAGES == tgs[i].mode) {
+			bts[i].dsts = linkall_dsts(&set, asort);
+			bts[i].dstsz = sargsz;
+			continue;
+		} else if (TGT_INDEX == tgs[i].mode) {
+			if ( ! build_index(&bts[i], &set, asort))
+				goto out;
+			continue;
+		}
+		job.items[job.itemsz++].bt = &bts[i];
+	}
+
+	for (i = 0; i < tgsz; i++) {
+		if (NULL == bts[i].dsts)
+			continue;
+		job.items = xreallocarray(job.items, 
+			job.itemsz + bts[i].dstsz, sizeof(struct bitem));
+		for (j = 0; j < bts[i].dstsz; j++) {
+			if (NULL == bts[i].dsts[j])
+				continue;
+			job.items[job.itemsz].bt = &bts[i];
+			job.items[job.itemsz++].page = j;
+		}
+	}
+
+	/* 
+	 * Render, sharing the articles between workers, and write from
+	 * another thread, bounding pending outputs to a few per worker.
+	 * With only one, render and write here.
+	 */
+
+	job.set = &set;
+	job.asort = asort;
+	job.rst = rst;
+	job.wst = wst;
+	if (0 != (er = pthread_mutex_init(&job.mutex, NULL))) {
+		errno = er;
+		err(EXIT_FAILURE, "pthread_mutex_init");
+	}
+
+	nthreads = po->jobs < job.itemsz ? po->jobs : job.itemsz;
+
+	if (nthreads <= 1)
+		build_worker(&job);
+	else {
+		artset_share(&set);
+		job.writer = writer_alloc(2 * nthreads, nthreads, wst);
+		threads = xcalloc(nthreads, sizeof(pthread_t));
+		for (i = 0; i < nthreads; i++) {
+			er = pthread_create(&threads[i], 
+				NULL, build_worker, &job);
+			if (0 != er) {
+				errno = er;
+				err(EXIT_FAILURE, "pthread_create");
+			}
+		}
+		for (i = 0; i < nthreads; i++)
+			pthread_join(threads[i], NULL);
+		free(threads);
+		if ( ! writer_free(job.writer))
+			job.failed = 1;
+	}
+
+	pthread_mutex_destroy(&job.mutex);
+	rc = ! job.failed;
+
+	wall = stage_time() - start;
+	stage_print(pst, wall);
+	stage_print(rst, wall);
+	stage_print(wst, wall);
+out:
+	stage_free(pst);
+	stage_free(rst);
+	stage_free(wst);
+	for (i = 0; i < tgsz; i++) {
+		if (NULL != bts[i].dsts)
+			for (j = 0; j < bts[i].dstsz; j++)
+				free(bts[i].dsts[j]);
+		free(bts[i].dsts);
+		free(bts[i].starts);
+		free(bts[i].pages);
+		tmpl_free(bts[i].t);
+	}
+	free(bts);
+	free(job.items);
+	artset_free(&set);
+	sblg_free(sargs, sargsz);
+	return(rc);
+}
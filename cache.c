@@ -0,0 +1,652 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <expat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+#if defined(__APPLE__)
+# define st_mtim st_mtimespec
+# define st_ctim st_ctimespec
+#endif
+
+/*
+ * The on-disk cache is a header followed by one record per source file.
+ * All integers are 64-bit in host byte order: the header records the
+ * byte order and we discard caches written with another.
+ * Strings are a length followed by the bytes (no nil terminator), or
+ * CACHE_NULL alone for a NULL string.
+ * Each record is prefixed by its length so we can skip or copy it
+ * without decoding.
+ *
+ *   "sblg-kch" version order
+ *   [ reclen path key[7] nart [article...] ]...
+ *
+ * Bump CACHE_VERSION whenever the record layout or the meaning of any
+ * parsed field changes: older caches are then silently rebuilt.
+ */
+#define	CACHE_MAGIC	"sblg-kch"
+#define	CACHE_VERSION	2
+#define	CACHE_ORDER	0x0102030405060708ULL
+#define	CACHE_NULL	UINT64_MAX
+
+/*
+ * Identity of a source file.
+ * The ctime is included because an article without a <time> takes its
+ * date from it.
+ */
+struct	ckey {
+	uint64_t	 dev;
+	uint64_t	 ino;
+	uint64_t	 size;
+	uint64_t	 mtime;
+	uint64_t	 mtimens;
+	uint64_t	 ctime;
+	uint64_t	 ctimens;
+};
+
+/*
+ * A record in the existing cache file.
+ */
+struct	centry {
+	char		*path; /* source path (nil-terminated) */
+	struct ckey	 key; /* identity when cached */
+	const char	*rec; /* full record (with length) */
+	size_t		 recsz; /* length of rec */
+	const char	*arts; /* start of article data */
+	size_t		 artsz; /* length of arts */
+	uint64_t	 nart; /* number of articles */
+	int		 used; /* referenced by a source */
+};
+
+/*
+ * A source file being parsed in this invocation.
+ */
+struct	csrc {
+	const char	*path; /* source path */
+	int		 valid; /* whether key is valid */
+	struct ckey	 key; /* identity before parsing */
+	struct centry	*hit; /* matching cache entry or NULL */
+	char		*rec; /* newly-serialised record or NULL */
+	size_t		 recsz; /* length of rec */
+};
+
+struct	cache {
+	const char	*fn; /* cache file */
+	int		 fd; /* mapped cache or -1 */
+	char		*buf; /* mapped cache */
+	size_t		 bufsz; /* length of buf */
+	struct centry	*ents; /* existing entries, sorted by path */
+	size_t		 entsz; /* number of ents */
+	struct csrc	*srcs; /* all sources */
+	size_t		 srcsz; /* number of srcs */
+	int		 dirty; /* whether to rewrite */
+};
+
+/*
+ * Bounds-checked reader over a cache buffer.
+ */
+struct	cbuf {
+	const char	*p;
+	size_t		 sz;
+	size_t		 pos;
+};
+
+/*
+ * Growable write buffer for serialisation.
+ */
+struct	cout {
+	char		*p;
+	size_t		 sz;
+	size_t		 max;
+};
+
+static void
+cout_write(struct cout *o, const void *p, size_t sz)
+{
+
+	if (o->sz + sz > o->max) {
+		o->max = (o->sz + sz) * 2;
+		o->p = xrealloc(o->p, o->max);
+	}
+	memcpy(o->p + o->sz, p, sz);
+	o->sz += sz;
+}
+
+static void
+cout_u64(struct cout *o, uint64_t v)
+{
+
+	cout_write(o, &v, sizeof(uint64_t));
+}
+
+static void
+cout_str(struct cout *o, const char *s)
+{
+	size_t	 sz;
+
+	if (NULL == s) {
+		cout_u64(o, CACHE_NULL);
+		return;
+	}
+	sz = strlen(s);
+	cout_u64(o, sz);
+	cout_write(o, s, sz);
+}
+
+static int
+cbuf_u64(struct cbuf *b, uint64_t *v)
+{
+
+	if (b->sz - b->pos < sizeof(uint64_t))
+		return(0);
+	memcpy(v, b->p + b->pos, sizeof(uint64_t));
+	b->pos += sizeof(uint64_t);
+	return(1);
+}
+
+/*
+ * Read a string as a nil-terminated string (or NULL, with zero length).
+ * If "a" is NULL, the string is allocated from the heap.
+ */
+static int
+cbuf_str(struct cbuf *b, struct arena *a, char **s, size_t *sz)
+{
+	uint64_t v;
+
+	if ( ! cbuf_u64(b, &v))
+		return(0);
+	if (CACHE_NULL == v) {
+		*s = NULL;
+		if (NULL != sz)
+			*sz = 0;
+		return(1);
+	}
+	if (b->sz - b->pos < v)
+		return(0);
+	*s = NULL == a ?
+		xstrndup(b->p + b->pos, v) :
+		arena_strndup(a, b->p + b->pos, v);
+	if (NULL != sz)
+		*sz = v;
+	b->pos += v;
+	return(1);
+}
+
+static int
+cbuf_key(struct cbuf *b, struct ckey *k)
+{
+
+	return(cbuf_u64(b, &k->dev) &&
+	       cbuf_u64(b, &k->ino) &&
+	       cbuf_u64(b, &k->size) &&
+	       cbuf_u64(b, &k->mtime) &&
+	       cbuf_u64(b, &k->mtimens) &&
+	       cbuf_u64(b, &k->ctime) &&
+	       cbuf_u64(b, &k->ctimens));
+}
+
+static void
+cout_key(struct cout *o, const struct ckey *k)
+{
+
+	cout_u64(o, k->dev);
+	cout_u64(o, k->ino);
+	cout_u64(o, k->size);
+	cout_u64(o, k->mtime);
+	cout_u64(o, k->mtimens);
+	cout_u64(o, k->ctime);
+	cout_u64(o, k->ctimens);
+}
+
+static int
+ckey_stat(const char *fn, struct ckey *k)
+{
+	struct stat	 st;
+
+	if (-1 == stat(fn, &st) || ! S_ISREG(st.st_mode))
+		return(0);
+
+	memset(k, 0, sizeof(struct ckey));
+	k->dev = st.st_dev;
+	k->ino = st.st_ino;
+	k->size = st.st_size;
+	k->mtime = st.st_mtim.tv_sec;
+	k->mtimens = st.st_mtim.tv_nsec;
+	k->ctime = st.st_ctim.tv_sec;
+	k->ctimens = st.st_ctim.tv_nsec;
+	return(1);
+}
+
+static int
+centry_cmp(const void *p1, const void *p2)
+{
+	const struct centry *e1 = p1, *e2 = p2;
+
+	return(strcmp(e1->path, e2->path));
+}
+
+static void
+cache_entries_free(struct cache *c)
+{
+	size_t	 i;
+
+	for (i = 0; i < c->entsz; i++)
+		free(c->ents[i].path);
+	free(c->ents);
+	c->ents = NULL;
+	c->entsz = 0;
+}
+
+/*
+ * Index the records of a mapped cache file.
+ * On any inconsistency, we throw away the entire cache.
+ */
+static void
+cache_index(struct cache *c)
+{
+	struct cbuf	 b, r;
+	uint64_t	 v, reclen;
+	struct centry	*e;
+
+	b.p = c->buf;
+	b.sz = c->bufsz;
+	b.pos = 0;
+
+	if (b.sz < 8 || memcmp(b.p, CACHE_MAGIC, 8))
+		return;
+	b.pos = 8;
+	if ( ! cbuf_u64(&b, &v) || CACHE_VERSION != v)
+		return;
+	if ( ! cbuf_u64(&b, &v) || CACHE_ORDER != v)
+		return;
+
+	while (b.pos < b.sz) {
+		if ( ! cbuf_u64(&b, &reclen) || b.sz - b.pos < reclen)
+			goto bad;
+		c->ents = xreallocarray(c->ents,
+			c->entsz + 1, sizeof(struct centry));
+		e = &c->ents[c->entsz++];
+		memset(e, 0, sizeof(struct centry));
+		e->rec = b.p + b.pos - sizeof(uint64_t);
+		e->recsz = reclen + sizeof(uint64_t);
+
+		r.p = b.p + b.pos;
+		r.sz = reclen;
+		r.pos = 0;
+		if ( ! cbuf_str(&r, NULL, &e->path, NULL) ||
+		    NULL == e->path ||
+		    ! cbuf_key(&r, &e->key) ||
+		    ! cbuf_u64(&r, &e->nart))
+			goto bad;
+		e->arts = r.p + r.pos;
+		e->artsz = r.sz - r.pos;
+		b.pos += reclen;
+	}
+
+	if (c->entsz > 0)
+		qsort(c->ents, c->entsz, 
+			sizeof(struct centry), centry_cmp);
+	return;
+bad:
+	cache_entries_free(c);
+}
+
+/*
+ * Open the cache "fn" for the given sources.
+ * A missing, unreadable, or stale-format cache is treated as empty.
+ * Each source is stat(2)'d here, before it's parsed, so that a file
+ * modified during parsing will not match on the next run.
+ */
+struct cache *
+cache_open(const char *fn, int sz, char *src[])
+{
+	struct cache	*c;
+	struct stat	 st;
+	struct centry	 key;
+	size_t		 i;
+
+	c = xcalloc(1, sizeof(struct cache));
+	c->fn = fn;
+	c->fd = -1;
+
+	if (-1 == stat(fn, &st)) {
+		if (ENOENT != errno)
+			warn("%s", fn);
+		c->dirty = 1;
+	} else if (mmap_open(fn, &c->fd, &c->buf, &c->bufsz))
+		cache_index(c);
+
+	if (0 == c->entsz)
+		c->dirty = 1;
+
+	c->srcsz = sz;
+	c->srcs = xcalloc(sz, sizeof(struct csrc));
+
+	for (i = 0; i < c->srcsz; i++) {
+		c->srcs[i].path = src[i];
+		c->srcs[i].valid = ckey_stat(src[i], &c->srcs[i].key);
+		if ( ! c->srcs[i].valid || 0 == c->entsz)
+			continue;
+		key.path = src[i];
+		c->srcs[i].hit = bsearch(&key, c->ents,
+			c->entsz, sizeof(struct centry), centry_cmp);
+		if (NULL == c->srcs[i].hit)
+			continue;
+		c->srcs[i].hit->used = 1;
+		if (memcmp(&c->srcs[i].hit->key,
+		    &c->srcs[i].key, sizeof(struct ckey)))
+			c->srcs[i].hit = NULL;
+	}
+
+	return(c);
+}
+
+static int
+article_read(struct cbuf *b, struct arena *ar, struct article *a)
+{
+	uint64_t v, n, i;
+
+	a->arena = ar;
+
+	if ( ! cbuf_str(b, ar, &a->base, NULL) ||
+	    ! cbuf_str(b, ar, &a->stripbase, NULL) ||
+	    ! cbuf_str(b, ar, &a->striplangbase, NULL) ||
+	    ! cbuf_str(b, ar, &a->title, &a->titlesz) ||
+	    ! cbuf_str(b, ar, &a->titletext, &a->titletextsz) ||
+	    ! cbuf_str(b, ar, &a->aside, &a->asidesz) ||
+	    ! cbuf_str(b, ar, &a->asidetext, &a->asidetextsz) ||
+	    ! cbuf_str(b, ar, &a->author, &a->authorsz) ||
+	    ! cbuf_str(b, ar, &a->authortext, &a->authortextsz) ||
+	    ! cbuf_str(b, ar, &a->article, &a->articlesz))
+		return(0);
+
+	if ( ! cbuf_u64(b, &v))
+		return(0);
+	a->time = (time_t)(int64_t)v;
+	if ( ! cbuf_u64(b, &v))
+		return(0);
+	a->isdatetime = v;
+	if ( ! cbuf_u64(b, &v) || v > SORT_LAST)
+		return(0);
+	a->sort = v;
+
+	if ( ! cbuf_u64(b, &v))
+		return(0);
+	if (v && ! cbuf_str(b, ar, &a->img, NULL))
+		return(0);
+
+	if ( ! cbuf_u64(b, &n) || n > b->sz / sizeof(uint64_t))
+		return(0);
+	if (n > 0)
+		a->tagmap = arena_malloc(ar, n * sizeof(char *));
+	for (i = 0; i < n; i++, a->tagmapsz++)
+		if ( ! cbuf_str(b, ar, &a->tagmap[i], NULL))
+			return(0);
+
+	if ( ! cbuf_u64(b, &n) || n > b->sz / sizeof(uint64_t))
+		return(0);
+	if (n > 0)
+		a->setmap = arena_malloc(ar, n * sizeof(char *));
+	for (i = 0; i < n; i++, a->setmapsz++)
+		if ( ! cbuf_str(b, ar, &a->setmap[i], NULL))
+			return(0);
+
+	return(1);
+}
+
+static void
+article_write(struct cout *o, const struct article *a)
+{
+	size_t	 i;
+
+	cout_str(o, a->base);
+	cout_str(o, a->stripbase);
+	cout_str(o, a->striplangbase);
+	cout_str(o, a->title);
+	cout_str(o, a->titletext);
+	cout_str(o, a->aside);
+	cout_str(o, a->asidetext);
+	cout_str(o, a->author);
+	cout_str(o, a->authortext);
+	cout_str(o, NULL == a->article ? "" : a->article);
+	cout_u64(o, (uint64_t)(int64_t)a->time);
+	cout_u64(o, a->isdatetime);
+	cout_u64(o, a->sort);
+	cout_u64(o, NULL != a->img);
+	if (NULL != a->img)
+		cout_str(o, a->img);
+	cout_u64(o, a->tagmapsz);
+	for (i = 0; i < a->tagmapsz; i++)
+		cout_str(o, a->tagmap[i]);
+	cout_u64(o, a->setmapsz);
+	for (i = 0; i < a->setmapsz; i++)
+		cout_str(o, a->setmap[i]);
+}
+
+/*
+ * If source "idx" is unchanged since it was cached, append its articles
+ * to "arg" as sblg_parse() would and return non-zero.
+ * Returns zero if the source must be parsed.
+ */
+int
+cache_get(struct cache *c, size_t idx,
+	struct article **arg, size_t *argsz)
+{
+	struct csrc	*s;
+	struct cbuf	 b;
+	struct article	*arts;
+	struct arena	*ar;
+	size_t		 i, sz;
+	const char	*cp;
+
+	s = &c->srcs[idx];
+	if (NULL == s->hit)
+		return(0);
+
+	if (s->hit->nart > s->hit->artsz) {
+		s->hit = NULL;
+		return(0);
+	} else if (0 == (sz = s->hit->nart))
+		return(1);
+
+	/* All articles in a vector share an arena. */
+
+	ar = *argsz > 0 ? (*arg)[0].arena : arena_alloc();
+	arts = xcalloc(sz, sizeof(struct article));
+
+	b.p = s->hit->arts;
+	b.sz = s->hit->artsz;
+	b.pos = 0;
+
+	for (i = 0; i < sz; i++)
+		if ( ! article_read(&b, ar, &arts[i])) {
+			if (0 == *argsz)
+				arena_free(ar);
+			free(arts);
+			s->hit = NULL;
+			c->dirty = 1;
+			return(0);
+		}
+
+	*arg = xreallocarray(*arg,
+		*argsz + sz, sizeof(struct article));
+	memcpy(&(*arg)[*argsz], arts, sz * sizeof(struct article));
+	free(arts);
+
+	cp = strrchr(s->path, '/');
+	for (i = 0; i < sz; i++) {
+		(*arg)[*argsz].src = s->path;
+		(*arg)[*argsz].stripsrc = NULL == cp ? s->path : cp + 1;
+		(*arg)[*argsz].order = *argsz + 1;
+		(*argsz)++;
+	}
+
+	return(1);
+}
+
+/*
+ * Record the articles "arts" of length "sz" parsed from source "idx".
+ * These will be written when the cache is closed.
+ */
+void
+cache_set(struct cache *c, size_t idx,
+	const struct article *arts, size_t sz)
+{
+	struct csrc	*s;
+	struct cout	 o;
+	size_t		 i;
+	uint64_t	 len;
+
+	s = &c->srcs[idx];
+	if ( ! s->valid || NULL != s->rec)
+		return;
+
+	memset(&o, 0, sizeof(struct cout));
+	cout_u64(&o, 0);
+	cout_str(&o, s->path);
+	cout_key(&o, &s->key);
+	cout_u64(&o, sz);
+	for (i = 0; i < sz; i++)
+		article_write(&o, &arts[i]);
+
+	len = o.sz - sizeof(uint64_t);
+	memcpy(o.p, &len, sizeof(uint64_t));
+	s->rec = o.p;
+	s->recsz = o.sz;
+	c->dirty = 1;
+}
+
+static int
+cache_write(const struct cache *c)
+{
+	char		*tmp;
+	FILE		*f;
+	int		 fd;
+	size_t		 i, sz;
+	uint64_t	 v;
+	struct ckey	 key;
+	struct strmap	*seen;
+
+	sz = strlen(c->fn) + 8;
+	tmp = xmalloc(sz);
+	snprintf(tmp, sz, "%s.XXXXXX", c->fn);
+
+	if (-1 == (fd = mkstemp(tmp))) {
+		warn("%s", tmp);
+		free(tmp);
+		return(0);
+	} else if (NULL == (f = fdopen(fd, "w"))) {
+		warn("%s", tmp);
+		close(fd);
+		unlink(tmp);
+		free(tmp);
+		return(0);
+	}
+
+	fwrite(CACHE_MAGIC, 1, 8, f);
+	v = CACHE_VERSION;
+	fwrite(&v, sizeof(uint64_t), 1, f);
+	v = CACHE_ORDER;
+	fwrite(&v, sizeof(uint64_t), 1, f);
+
+	/*
+	 * Sources from this run, once each.
+	 * Either freshly-parsed or copied verbatim from the cache.
+	 */
+
+	seen = strmap_alloc();
+	for (i = 0; i < c->srcsz; i++) {
+		sz = strmap_size(seen);
+		if (strmap_put(seen, c->srcs[i].path) < sz)
+			continue;
+		if (NULL != c->srcs[i].rec)
+			fwrite(c->srcs[i].rec, 1, c->srcs[i].recsz, f);
+		else if (NULL != c->srcs[i].hit)
+			fwrite(c->srcs[i].hit->rec,
+				1, c->srcs[i].hit->recsz, f);
+	}
+	strmap_free(seen);
+
+	/*
+	 * Entries for files not in this run (e.g., another invocation
+	 * using a different file list).
+	 * Keep those that are still current.
+	 */
+
+	for (i = 0; i < c->entsz; i++) {
+		if (c->ents[i].used)
+			continue;
+		if ( ! ckey_stat(c->ents[i].path, &key) ||
+		    memcmp(&key, &c->ents[i].key, sizeof(struct ckey)))
+			continue;
+		fwrite(c->ents[i].rec, 1, c->ents[i].recsz, f);
+	}
+
+	if (ferror(f) || EOF == fclose(f)) {
+		warn("%s", tmp);
+		unlink(tmp);
+		free(tmp);
+		return(0);
+	} else if (-1 == rename(tmp, c->fn)) {
+		warn("%s", c->fn);
+		unlink(tmp);
+		free(tmp);
+		return(0);
+	}
+
+	free(tmp);
+	return(1);
+}
+
+/*
+ * Write out the cache (if changed) and free all resources.
+ * Failing to write the cache is not an error: it'll simply be rebuilt
+ * on the next run.
+ */
+void
+cache_close(struct cache *c)
+{
+	size_t	 i;
+
+	if (NULL == c)
+		return;
+
+	if (c->dirty)
+		cache_write(c);
+
+	for (i = 0; i < c->srcsz; i++)
+		free(c->srcs[i].rec);
+
+	cache_entries_free(c);
+	mmap_close(c->fd, c->buf, c->bufsz);
+	free(c->srcs);
+	free(c);
+}
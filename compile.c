@@ -20,210 +20,327 @@
 #if HAVE_ERR
 # include <err.h>
 #endif
+#include <errno.h>
 #include <expat.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include <unistd.h>
 
 #include "extern.h"
 
-struct	pargs {
-	const char	*src; /* template file */
-	const char	*dst; /* output file (or empty) */
-	FILE		*f; /* output stream */
-	XML_Parser	 p; /* active parser */
-	size_t		 stack; /* temporary: tag stack size */
-	struct article	*article; /* standalone article */
-	char		*buf; /* buffer for text */
-	size_t		 bufsz; /* buffer size */
-	size_t		 bufmax; /* buffer maximum size */
-};
 
-static void
-template_text(void *dat, const XML_Char *s, int len)
+/*
+ * Parse the single article in "src" for compile().
+ * Returns zero on failure, having reported it.
+ */
+static int
+compile_parse(XML_Parser p, const char *src, 
+	struct article **sargs, size_t *sargsz)
 {
-	struct pargs	*arg = dat;
 
-	xmlstrtext(&arg->buf, &arg->bufsz, s, len);
-}
+	*sargs = NULL;
+	*sargsz = 0;
 
-static void
-template_end(void *dat, const XML_Char *name)
-{
-	struct pargs	*arg = dat;
+	if ( ! sblg_parse(p, src, sargs, sargsz)) {
+		sblg_free(*sargs, *sargsz);
+		return(0);
+	}
+
+	if (0 == *sargsz) {
+		warnx("%s: contains no article", src);
+		sblg_free(*sargs, *sargsz);
+		return(0);
+	} else if (*sargsz > 1)
+		warnx("%s: contains multiple "
+			"articles (using the first)", src);
 
-	xmltextx(arg->f, arg->buf, arg->dst, arg->article, 1, 0);
-	xmlstrflush(arg->buf, &arg->bufsz);
-	xmlclose(arg->f, name);
+	return(1);
 }
 
 /*
- * Record the stack of nested <article> entries so we don't prematurely
- * close the article context.
+ * Open the output for "src" as named in compile() and fill the template
+ * "t" with its article "sarg".
+ * If "mem", the output is kept in memory (see out_mem()).
+ * Returns the output for the caller to close or NULL on failure.
  */
-static void
-article_begin(void *dat, const XML_Char *name, const XML_Char **atts)
+static struct out *
+compile_render(const struct tmpl *t, const char *src, 
+	struct article *sarg, const char *dst, const char *dir, int mem)
 {
-	struct pargs	*arg = dat;
+	char		*out, *path = NULL;
+	const char	*fn;
+	struct out	*f = NULL;
+	struct artset	 set;
+
+	out = NULL == dst ? outname(src) : xstrdup(dst);
+
+	if (NULL != dir && strcmp(out, "-")) {
+		path = outpath(dir, out);
+		if ( ! mkparents(path))
+			goto out;
+	}
+
+	fn = NULL != path ? path : out;
+	if (NULL == (f = mem ? out_mem(fn) : out_open(fn)))
+		goto out;
 
-	arg->stack += 0 == strcasecmp(name, "article");
+	artset_init(&set, sarg, 1);
+	tmpl_exec(t, f, strcmp(out, "-") ? out : NULL, 
+		&set, ASORT_CMDLINE, 0, 1, 0, NULL);
+	artset_free(&set);
+	out_putc(f, '\n');
+out:
+	free(path);
+	free(out);
+	return(f);
 }
 
 /*
- * If we're at the bottom of the stack of <article> entries, we're
- * finished with this article; print the rest verbatim.
+ * Fill the compiled template "t" with the single article in "src",
+ * writing to "dst" or, if NULL, "src" with ".html" in place of ".xml"
+ * (see outname()).
+ * If "dir" isn't NULL, this is written within it (see outpath()).
  */
-static void
-article_end(void *dat, const XML_Char *name)
+int
+compile(XML_Parser p, const struct tmpl *t, 
+	const char *src, const char *dst, const char *dir)
 {
-	struct pargs	*arg = dat;
+	struct article	*sargs;
+	size_t		 sargsz;
+	struct out	*f;
+	int		 rc;
 
-	if (0 == strcasecmp(name, "article") && 0 == --arg->stack) {
-		XML_SetElementHandler(arg->p, NULL, NULL);
-		XML_SetDefaultHandlerExpand(arg->p, template_text);
-	}
+	if ( ! compile_parse(p, src, &sargs, &sargsz))
+		return(0);
+
+	f = compile_render(t, src, sargs, dst, dir, 0);
+	rc = NULL != f;
+	if ( ! out_close(f))
+		rc = 0;
+
+	sblg_free(sargs, sargsz);
+	return(rc);
 }
 
 /*
- * Look for important tags in the template.
- * This is the main handler for this file.
+ * An input file parsed by compile_all() for rendering.
+ */
+struct	cfile {
+	const char	*src; /* input file */
+	struct article	*sargs; /* its articles */
+	size_t		 sargsz; /* number of articles */
+};
+
+/*
+ * Files being compiled by compile_all(), shared by its workers.
+ * Parsers take files one at a time and put them into "parsed", from
+ * which renderers take them and pass their outputs to the writer.
  */
+struct	cjob {
+	const struct tmpl *t; /* compiled template */
+	char		**src; /* input files */
+	size_t		 sz; /* number of input files */
+	const char	*dir; /* output directory or NULL */
+	size_t		 next; /* next file to take */
+	int		 failed; /* whether any file failed */
+	pthread_mutex_t	 mutex; /* guards next and failed */
+	struct queue	*parsed; /* struct cfile from parsers */
+	struct writer	*writer; /* outputs from renderers */
+	struct stage	*pst; /* parser statistics or NULL */
+	struct stage	*rst; /* renderer statistics or NULL */
+	struct stage	*wst; /* writer statistics or NULL */
+};
+
 static void
-template_begin(void *dat, const XML_Char *name, const XML_Char **atts)
+compile_fail(struct cjob *job)
 {
-	struct pargs	 *arg = dat;
-	const XML_Char	**attp;
 
-	assert(0 == arg->stack);
+	pthread_mutex_lock(&job->mutex);
+	job->failed = 1;
+	pthread_mutex_unlock(&job->mutex);
+}
 
-	xmltextx(arg->f, arg->buf, arg->dst, arg->article, 1, 0);
-	xmlstrflush(arg->buf, &arg->bufsz);
+static void *
+parse_worker(void *dat)
+{
+	struct cjob	*job = dat;
+	struct cfile	*cf;
+	XML_Parser	 p;
+	size_t		 i, items = 0;
+	double		 start, wait = 0.0;
+
+	start = stage_time();
+	if (NULL == (p = XML_ParserCreate(NULL)))
+		err(EXIT_FAILURE, "XML_ParserCreate");
+
+	for (;;) {
+		pthread_mutex_lock(&job->mutex);
+		i = job->next++;
+		pthread_mutex_unlock(&job->mutex);
+
+		if (i >= job->sz)
+			break;
 
-	if (strcasecmp(name, "article")) {
-		xmlopensx(arg->f, name, atts, 
-			arg->dst, arg->article, 1, 0);
-		return;
+		items++;
+		cf = xcalloc(1, sizeof(struct cfile));
+		cf->src = job->src[i];
+		if (compile_parse(p, cf->src, &cf->sargs, &cf->sargsz)) {
+			queue_put(job->parsed, cf, &wait);
+			continue;
+		}
+		free(cf);
+		compile_fail(job);
 	}
 
-	for (attp = atts; NULL != *attp; attp += 2)
-		if (0 == strcasecmp(*attp, "data-sblg-article"))
-			break;
+	XML_ParserFree(p);
+	queue_done(job->parsed);
+	stage_add(job->pst, items, stage_time() - start - wait, wait);
+	return(NULL);
+}
 
-	if (NULL == *attp || ! xmlbool(attp[1])) {
-		xmlopensx(arg->f, name, atts, 
-			arg->dst, arg->article, 1, 0);
-		return;
+static void *
+render_worker(void *dat)
+{
+	struct cjob	*job = dat;
+	struct cfile	*cf;
+	struct out	*f;
+	size_t		 items = 0;
+	double		 start, wait = 0.0;
+
+	start = stage_time();
+	while (NULL != (cf = queue_get(job->parsed, &wait))) {
+		items++;
+		f = compile_render(job->t, cf->src, 
+			cf->sargs, NULL, job->dir, 1);
+		sblg_free(cf->sargs, cf->sargsz);
+		free(cf);
+		if (NULL != f)
+			writer_put(job->writer, f, &wait);
+		else
+			compile_fail(job);
 	}
 
-	/*
-	 * If we encounter an <article data-sblg-article="1">, then echo
-	 * the article file and discard content until the matching close
-	 * of the article.
-	 */
-	arg->stack++;
-	XML_SetElementHandler(arg->p, article_begin, article_end);
-	XML_SetDefaultHandlerExpand(arg->p, NULL);
-	xmltextx(arg->f, arg->article->article, 
-		arg->dst, arg->article, 1, 0);
+	writer_done(job->writer);
+	stage_add(job->rst, items, stage_time() - start - wait, wait);
+	return(NULL);
 }
 
-int
-compile(XML_Parser p, const char *templ, 
-	const char *src, const char *dst)
+/*
+ * Run each stage of compile_all() in turn for each file.
+ */
+static void
+compile_serial(struct cjob *job)
 {
-	char		*out, *cp, *buf;
-	size_t		 sz, sargsz;
-	int		 fd, rc;
-	FILE		*f;
-	struct pargs	 arg;
+	XML_Parser	 p;
 	struct article	*sargs;
+	struct out	*f;
+	size_t		 i, sargsz, items = 0;
+	int		 rc;
+	double		 t0, t1, t2, busy[3] = { 0.0, 0.0, 0.0 };
+
+	if (NULL == (p = XML_ParserCreate(NULL)))
+		err(EXIT_FAILURE, "XML_ParserCreate");
+
+	for (i = 0; i < job->sz; i++) {
+		t0 = stage_time();
+		rc = compile_parse(p, job->src[i], &sargs, &sargsz);
+		t1 = stage_time();
+		busy[0] += t1 - t0;
+		if ( ! rc) {
+			job->failed = 1;
+			continue;
+		}
+
+		items++;
+		f = compile_render(job->t, job->src[i], 
+			sargs, NULL, job->dir, 1);
+		sblg_free(sargs, sargsz);
+		t2 = stage_time();
+		busy[1] += t2 - t1;
+
+		if (NULL == f || ! out_close(f))
+			job->failed = 1;
+		busy[2] += stage_time() - t2;
+	}
 
-	memset(&arg, 0, sizeof(struct pargs));
-
-	rc = 0;
-	buf = out = NULL;
-	fd = -1;
-	f = NULL;
-	sz = 0;
-	sargs = NULL;
-	sargsz = 0;
-
-	if ( ! sblg_parse(p, src, &sargs, &sargsz))
-		goto out;
-
-	if (0 == sargsz) {
-		warnx("%s: contains no article", src);
-		goto out;
-	} else if (sargsz > 1)
-		warnx("%s: contains multiple "
-			"articles (using the first)", src);
+	XML_ParserFree(p);
+	stage_add(job->pst, job->sz, busy[0], 0.0);
+	stage_add(job->rst, items, busy[1], 0.0);
+	stage_add(job->wst, items, busy[2], 0.0);
+}
 
-	arg.article = &sargs[0];
-
-	if (NULL == dst) {
-		/*
-		 * If we have no output file name, then name it the same
-		 * as the input but with ".html" at the end.
-		 * However, if we have ".xml", then replace that with
-		 * ".html".
-		 */
-		sz = strlen(src);
-		if (NULL == (cp = strrchr(src, '.')) ||
-				strcasecmp(cp + 1, "xml")) {
-			/* Append .html to input name. */
-			out = xmalloc(sz + 6);
-			strlcpy(out, src, sz + 6);
-			strlcat(out, ".html", sz + 6);
-		} else {
-			/* Replace .xml with .html. */
-			out = xmalloc(sz + 2);
-			strlcpy(out, src, sz - 2);
-			strlcat(out, "html", sz + 2);
-		} 
-	} else
-		out = xstrdup(dst);
-
-	f = stdout;
-	if (strcmp(out, "-") && NULL == (f = fopen(out, "w"))) {
-		warn("%s", out);
-		goto out;
-	} 
-	if ( ! mmap_open(templ, &fd, &buf, &sz))
-		goto out;
+/*
+ * Compile each of the "sz" files in "src" with the template "t" as in
+ * compile(), writing within "dir", if not NULL.
+ * With more than one of the parse options' jobs, that many threads
+ * parse and as many render, while another writes.
+ * A file that fails is reported on its own without stopping the rest.
+ * Returns zero if any failed.
+ */
+int
+compile_all(const struct popts *po, const struct tmpl *t, 
+	int sz, char *src[], const char *dir)
+{
+	struct cjob	 job;
+	pthread_t	*threads;
+	size_t		 i, nthreads;
+	int		 er;
+	double		 start, wall;
+
+	memset(&job, 0, sizeof(struct cjob));
+	job.t = t;
+	job.src = src;
+	job.sz = (size_t)sz;
+	job.dir = dir;
+	if (0 != (er = pthread_mutex_init(&job.mutex, NULL))) {
+		errno = er;
+		err(EXIT_FAILURE, "pthread_mutex_init");
+	}
 
-	arg.f = f;
-	arg.src = src;
-	arg.dst = strcmp(out, "-") ? out : NULL;
-	arg.p = p;
-
-	XML_ParserReset(p, NULL);
-	XML_SetElementHandler(p, template_begin, template_end);
-	XML_SetDefaultHandlerExpand(p, template_text);
-	XML_SetUserData(p, &arg);
-
-	if (XML_STATUS_OK != XML_Parse(p, buf, (int)sz, 1)) {
-		warnx("%s:%zu:%zu: %s", templ, 
-			XML_GetCurrentLineNumber(p),
-			XML_GetCurrentColumnNumber(p),
-			XML_ErrorString(XML_GetErrorCode(p)));
-		goto out;
-	} 
+	if (po->stats) {
+		job.pst = stage_alloc("parse");
+		job.rst = stage_alloc("render");
+		job.wst = stage_alloc("write");
+	}
 
-	xmltextx(arg.f, arg.buf, arg.dst, arg.article, 1, 0);
-	xmlstrflush(arg.buf, &arg.bufsz);
-	fputc('\n', f);
-	rc = 1;
-out:
-	mmap_close(fd, buf, sz);
-	if (NULL != f && stdin != f)
-		fclose(f);
+	start = stage_time();
+	nthreads = po->jobs < job.sz ? po->jobs : job.sz;
+
+	if (nthreads <= 1)
+		compile_serial(&job);
+	else {
+		/* Bound what's pending to a few files per thread. */
+
+		job.parsed = queue_alloc(2 * nthreads, nthreads);
+		job.writer = writer_alloc(2 * nthreads, nthreads, job.wst);
+		threads = xcalloc(2 * nthreads, sizeof(pthread_t));
+		for (i = 0; i < 2 * nthreads; i++) {
+			er = pthread_create(&threads[i], NULL, 
+				i < nthreads ? parse_worker : render_worker,
+				&job);
+			if (0 != er) {
+				errno = er;
+				err(EXIT_FAILURE, "pthread_create");
+			}
+		}
+		for (i = 0; i < 2 * nthreads; i++)
+			pthread_join(threads[i], NULL);
+		free(threads);
+		if ( ! writer_free(job.writer))
+			job.failed = 1;
+		queue_free(job.parsed);
+	}
 
-	sblg_free(sargs, sargsz);
-	free(out);
-	free(arg.buf);
-	return(rc);
+	wall = stage_time() - start;
+	stage_print(job.pst, wall);
+	stage_print(job.rst, wall);
+	stage_print(job.wst, wall);
+	stage_free(job.pst);
+	stage_free(job.rst);
+	stage_free(job.wst);
+	pthread_mutex_destroy(&job.mutex);
+	return( ! job.failed);
 }
-
@@ -0,0 +1,253 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <expat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * Parse exactly "sz" decimal digits from "cp" into "v".
+ * Returns zero if any aren't digits.
+ */
+static int
+digits(const char *cp, size_t sz, int *v)
+{
+	size_t	 i;
+
+	for (*v = 0, i = 0; i < sz; i++) {
+		if (cp[i] < '0' || cp[i] > '9')
+			return(0);
+		*v = *v * 10 + (cp[i] - '0');
+	}
+
+	return(1);
+}
+
+static int
+isleap(int y)
+{
+
+	return(0 == y % 4 && (0 != y % 100 || 0 == y % 400));
+}
+
+/*
+ * Days since the epoch of the given proleptic Gregorian date.
+ * This is the usual shifted-year computation with March as the first
+ * month so that the leap day falls at the end of the year.
+ */
+static int64_t
+epochdays(int y, int m, int d)
+{
+	int64_t	 era, yoe, doy, doe;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return(era * 146097 + doe - 719468);
+}
+
+/*
+ * Parse an RFC 3339 full-date ("2017-10-28") or date-time
+ * ("2017-10-28T12:00:00Z", with optional fractional seconds and either
+ * "Z" or a numeric offset) in "cp" into seconds since the epoch in UTC.
+ * The separator and "Z" may be lowercase, and the separator may be a
+ * space as the RFC allows.
+ * Fractional seconds are truncated; a leap second rolls over into the
+ * next minute, as timegm(3) would have it.
+ * This uses neither the locale nor the time zone.
+ * Returns zero if malformed, otherwise sets "isdatetime" to whether a
+ * time was given.
+ */
+int
+dateparse(const char *cp, time_t *t, int *isdatetime)
+{
+	static const int mdays[12] = 
+		{ 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	int	 y, mo, d, h, mi, s, oh, om, off;
+	int64_t	 v;
+
+	if ( ! digits(cp, 4, &y) || '-' != cp[4] ||
+	    ! digits(cp + 5, 2, &mo) || '-' != cp[7] ||
+	    ! digits(cp + 8, 2, &d))
+		return(0);
+
+	if (mo < 1 || mo > 12 || d < 1 ||
+	    d > mdays[mo - 1] + (2 == mo && isleap(y)))
+		return(0);
+
+	v = epochdays(y, mo, d) * 86400;
+	cp += 10;
+
+	if ('\0' == *cp) {
+		*t = (time_t)v;
+		*isdatetime = 0;
+		return(1);
+	}
+
+	if (('T' != *cp && 't' != *cp && ' ' != *cp) ||
+	    ! digits(cp + 1, 2, &h) || ':' != cp[3] ||
+	    ! digits(cp + 4, 2, &mi) || ':' != cp[6] ||
+	    ! digits(cp + 7, 2, &s))
+		return(0);
+
+	if (h > 23 || mi > 59 || s > 60)
+		return(0);
+
+	v += h * 3600 + mi * 60 + s;
+	cp += 9;
+
+	if ('.' == *cp) {
+		if (cp[1] < '0' || cp[1] > '9')
+			return(0);
+		for (cp++; *cp >= '0' && *cp <= '9'; cp++)
+			continue;
+	}
+
+	if ('Z' == *cp || 'z' == *cp) {
+		off = 0;
+		cp++;
+	} else if ('+' == *cp || '-' == *cp) {
+		if ( ! digits(cp + 1, 2, &oh) || ':' != cp[3] ||
+		    ! digits(cp + 4, 2, &om) || oh > 23 || om > 59)
+			return(0);
+		off = oh * 3600 + om * 60;
+		if ('-' == *cp)
+			off = -off;
+		cp += 6;
+	} else
+		return(0);
+
+	if ('\0' != *cp)
+		return(0);
+
+	*t = (time_t)(v - off);
+	*isdatetime = 1;
+	return(1);
+}
+
+static struct artdate *
+artdate_get(struct artset *s, size_t idx)
+{
+	struct artdate	*d;
+
+	if (NULL == s->dates) {
+		tzset();
+		s->dates = xcalloc(s->artsz, sizeof(struct artdate *));
+	}
+	if (NULL != s->dates[idx])
+		return(s->dates[idx]);
+
+	d = s->dates[idx] = xcalloc(1, sizeof(struct artdate));
+	gmtime_r(&s->arts[idx].time, &d->gmt);
+	localtime_r(&s->arts[idx].time, &d->local);
+	strftime(d->date, sizeof(d->date), "%F", &d->gmt);
+	strftime(d->datetime, sizeof(d->datetime), "%FT%TZ", &d->gmt);
+	strftime(d->localdate, sizeof(d->localdate), "%F", &d->local);
+	return(d);
+}
+
+/*
+ * Get the dates of article "idx", computing them the first time.
+ * The result is owned by "s".
+ */
+const struct artdate *
+artset_date(struct artset *s, size_t idx)
+{
+	const struct artdate *d;
+
+	artset_lock(s);
+	d = artdate_get(s, idx);
+	artset_unlock(s);
+	return(d);
+}
+
+/*
+ * Format the local time of article "idx" with the "fmtsz" bytes of
+ * "fmt" as for ${sblg-datetime-fmt}: a strftime(3) format, or "auto"
+ * or empty for the locale's date or date and time, depending upon
+ * whether the article has a time.
+ * Each format is computed once per article.
+ * The result is owned by "s".
+ */
+const char *
+artset_datefmt(struct artset *s, size_t idx, 
+	const char *fmt, size_t fmtsz)
+{
+	struct artdate	*d;
+	struct artfmt	*af;
+	const char	*cp;
+
+	if (NULL == fmt)
+		fmt = "";
+
+	artset_lock(s);
+	d = artdate_get(s, idx);
+
+	for (af = d->fmts; NULL != af; af = af->next)
+		if (af->fmtsz == fmtsz && 
+		    0 == memcmp(af->fmt, fmt, fmtsz)) {
+			artset_unlock(s);
+			return(af->buf);
+		}
+
+	af = xcalloc(1, sizeof(struct artfmt));
+	af->fmt = xstrndup(fmt, fmtsz);
+	af->fmtsz = fmtsz;
+	af->next = d->fmts;
+	d->fmts = af;
+
+	if (0 == fmtsz || 
+	    (4 == fmtsz && 0 == strncmp(fmt, "auto", fmtsz))) 
+		cp = s->arts[idx].isdatetime ? "%c" : "%x";
+	else
+		cp = af->fmt;
+
+	strftime(af->buf, sizeof(af->buf), cp, &d->local);
+	artset_unlock(s);
+	return(af->buf);
+}
+
+void
+datecache_free(struct artdate **dates, size_t sz)
+{
+	struct artfmt	*af;
+	size_t		 i;
+
+	if (NULL == dates)
+		return;
+
+	for (i = 0; i < sz; i++) {
+		if (NULL == dates[i])
+			continue;
+		while (NULL != (af = dates[i]->fmts)) {
+			dates[i]->fmts = af->next;
+			free(af->fmt);
+			free(af);
+		}
+		free(dates[i]);
+	}
+
+	free(dates);
+}
@@ -0,0 +1,146 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <assert.h>
+#include <expat.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+# include <immintrin.h>
+# define ESC_AVX2 1
+#endif
+
+#include "extern.h"
+
+/*
+ * Most bytes we escape for output need no escaping at all.
+ * These scanners find the next byte that does so that callers can copy
+ * clean runs in bulk.
+ * The vector variants compare a block against each byte of the set at
+ * once; the AVX2 one is used if the processor supports it.
+ */
+
+/*
+ * Maximum number of bytes in an escape set.
+ */
+#define	ESC_SETMAX	8
+
+typedef	size_t (*escspanf)(const char *, size_t, const char *, size_t);
+
+static	pthread_once_t	 esconce = PTHREAD_ONCE_INIT;
+static	escspanf	 escspanp;
+
+static size_t
+escspan_scalar(const char *cp, size_t sz, const char *set, size_t setsz)
+{
+	size_t	 i, j;
+
+	for (i = 0; i < sz; i++)
+		for (j = 0; j < setsz; j++)
+			if (cp[i] == set[j])
+				return(i);
+
+	return(sz);
+}
+
+#if defined(__SSE2__)
+static size_t
+escspan_sse2(const char *cp, size_t sz, const char *set, size_t setsz)
+{
+	__m128i	 v[ESC_SETMAX], b, m;
+	size_t	 i, j;
+	int	 mask;
+
+	for (j = 0; j < setsz; j++)
+		v[j] = _mm_set1_epi8(set[j]);
+
+	for (i = 0; i + 16 <= sz; i += 16) {
+		b = _mm_loadu_si128((const __m128i *)(cp + i));
+		m = _mm_cmpeq_epi8(b, v[0]);
+		for (j = 1; j < setsz; j++)
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(b, v[j]));
+		if (0 != (mask = _mm_movemask_epi8(m)))
+			return(i + __builtin_ctz(mask));
+	}
+
+	return(i + escspan_scalar(cp + i, sz - i, set, setsz));
+}
+#endif
+
+#if ESC_AVX2
+__attribute__((target("avx2")))
+static size_t
+escspan_avx2(const char *cp, size_t sz, const char *set, size_t setsz)
+{
+	__m256i	 v[ESC_SETMAX], b, m;
+	size_t	 i, j;
+	int	 mask;
+
+	for (j = 0; j < setsz; j++)
+		v[j] = _mm256_set1_epi8(set[j]);
+
+	for (i = 0; i + 32 <= sz; i += 32) {
+		b = _mm256_loadu_si256((const __m256i *)(cp + i));
+		m = _mm256_cmpeq_epi8(b, v[0]);
+		for (j = 1; j < setsz; j++)
+			m = _mm256_or_si256(m, _mm256_cmpeq_epi8(b, v[j]));
+		if (0 != (mask = _mm256_movemask_epi8(m)))
+			return(i + __builtin_ctz((unsigned int)mask));
+	}
+
+	return(i + escspan_scalar(cp + i, sz - i, set, setsz));
+}
+#endif
+
+static void
+escinit(void)
+{
+
+	escspanp = escspan_scalar;
+#if defined(__SSE2__)
+	escspanp = escspan_sse2;
+#endif
+#if ESC_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		escspanp = escspan_avx2;
+#endif
+}
+
+/*
+ * Return the length of the initial part of "cp", of length "sz", that
+ * contains none of the bytes in the nil-terminated "set".
+ * This is strcspn(3) over a buffer of known length.
+ */
+size_t
+escspan(const char *cp, size_t sz, const char *set)
+{
+	size_t	 setsz;
+
+	setsz = strlen(set);
+	assert(setsz > 0 && setsz <= ESC_SETMAX);
+
+	pthread_once(&esconce, escinit);
+	return(escspanp(cp, sz, set, setsz));
+}
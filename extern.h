@@ -28,38 +28,330 @@ enum	asort {
 	ASORT_CMDLINE
 };
 
-int	atom(XML_Parser p, const char *templ, int sz, 
+#define	ASORT__MAX (ASORT_CMDLINE + 1)
+
+/*
+ * What sblg_parse_all() does with article bodies.
+ */
+enum	pbody {
+	PBODY_FULL = 0, /* keep them */
+	PBODY_NONE, /* only metadata: bodies are empty */
+	PBODY_LAZY /* only extents: see artset_body() */
+};
+
+/*
+ * How we grok our input articles.
+ * This is passed to sblg_parse_all() by each of the multi-file modes.
+ */
+struct	popts {
+	size_t		 jobs; /* parser threads (<=1 is serial) */
+	const char	*cache; /* parse cache file or NULL */
+	enum pbody	 body; /* article bodies */
+	int		 stats; /* print stage statistics (-v) */
+};
+
+/*
+ * What a target of build() outputs (see target_parse()).
+ */
+enum	tgtmode {
+	TGT_BLOG = 0, /* blog amalgamation */
+	TGT_ATOM, /* Atom feed (-a) */
+	TGT_JSON, /* JSON amalgamation (-j) */
+	TGT_TAGS, /* tag listing (-l) */
+	TGT_PAGES, /* an output per article (-L) */
+	TGT_INDEX /* blog amalgamation in pages (-P) */
+};
+
+/*
+ * A target of build(), given by -T.
+ */
+struct	target {
+	enum tgtmode	 mode;
+	int		 json; /* TGT_TAGS as JSON (-j) */
+	int		 rev; /* TGT_TAGS tag-major (-r) */
+	const char	*templ; /* template or NULL if none */
+	const char	*dst; /* output (or TGT_PAGES directory or NULL) */
+	char		*buf; /* storage for the above */
+};
+
+/*
+ * How a template's elements are handled by tmpl_compile().
+ */
+enum	tmplmode {
+	TMPL_LINKALL = 0, /* linkall(): no substitution */
+	TMPL_LINKALL_SINGLE, /* linkall() -C and linkall_r() */
+	TMPL_COMPILE, /* compile() */
+	TMPL_INDEX /* build() TGT_INDEX: substitution */
+};
+
+/*
+ * A token of text to be substituted by xmltextx().
+ * This is either literal text or a ${sblg-xxx} placeholder.
+ */
+enum	xmltokt {
+	XMLTOK_NONE = 0, /* unknown placeholder */
+	XMLTOK_TEXT, /* literal text */
+	XMLTOK_ASIDE,
+	XMLTOK_ASIDETEXT,
+	XMLTOK_AUTHOR,
+	XMLTOK_AUTHORTEXT,
+	XMLTOK_BASE,
+	XMLTOK_DATE,
+	XMLTOK_DATETIME,
+	XMLTOK_DATETIME_FMT,
+	XMLTOK_FIRST_BASE,
+	XMLTOK_FIRST_STRIPBASE,
+	XMLTOK_FIRST_STRIPLANGBASE,
+	XMLTOK_GET,
+	XMLTOK_IMG,
+	XMLTOK_LAST_BASE,
+	XMLTOK_LAST_STRIPBASE,
+	XMLTOK_LAST_STRIPLANGBASE,
+	XMLTOK_NEXT_BASE,
+	XMLTOK_NEXT_STRIPBASE,
+	XMLTOK_NEXT_STRIPLANGBASE,
+	XMLTOK_PAGE,
+	XMLTOK_PAGE_NEXT,
+	XMLTOK_PAGE_PREV,
+	XMLTOK_PAGES,
+	XMLTOK_POS,
+	XMLTOK_PREV_BASE,
+	XMLTOK_PREV_STRIPBASE,
+	XMLTOK_PREV_STRIPLANGBASE,
+	XMLTOK_SOURCE,
+	XMLTOK_STRIPBASE,
+	XMLTOK_STRIPLANGBASE,
+	XMLTOK_TAGS,
+	XMLTOK_TITLE,
+	XMLTOK_TITLETEXT,
+	XMLTOK_URL
+};
+
+struct	xmltok {
+	enum xmltokt	 type;
+	const char	*str; /* literal text or argument (or NULL) */
+	size_t		 sz; /* length of str */
+};
+
+/*
+ * One of the pages of a paginated output (see tmpl_exec()).
+ */
+struct	page {
+	size_t		 num; /* page number from 1 */
+	size_t		 max; /* number of pages */
+	const char	*prev; /* previous page or NULL if first */
+	const char	*next; /* next page or NULL if last */
+};
+
+struct	cache;
+struct	out;
+struct	artsync;
+struct	queue;
+struct	stage;
+struct	strmap;
+struct	tagidx;
+struct	tagq;
+struct	tmpl;
+struct	writer;
+
+/*
+ * Returned by strmap_get() for unknown keys.
+ */
+#define	STRMAP_NONE ((size_t)-1)
+
+/*
+ * An article's date, broken down and formatted on first use by
+ * artset_date(), and with any custom formats by artset_datefmt().
+ */
+struct	artdate {
+	struct tm	 gmt; /* broken-down UTC */
+	struct tm	 local; /* broken-down local time */
+	char		 date[32]; /* UTC date (%F) */
+	char		 datetime[32]; /* UTC date and time (%FT%TZ) */
+	char		 localdate[32]; /* local date (%F) */
+	struct artfmt	*fmts; /* custom formats of local time */
+};
+
+struct	artfmt {
+	char		*fmt; /* format as given */
+	size_t		 fmtsz; /* length of fmt */
+	char		 buf[32]; /* formatted */
+	struct artfmt	*next; /* next format */
+};
+
+/*
+ * Parsed articles and their orderings.
+ * Articles never move once parsed: an ordering is a permutation of
+ * indices into "arts", built on first use by artset_order().
+ */
+struct	artset {
+	const struct article *arts; /* parsed articles */
+	size_t		 artsz; /* number of articles */
+	size_t		*order[ASORT__MAX]; /* orderings or NULL */
+	struct tagidx	*tagidx; /* tag index or NULL */
+	char		**bodies; /* materialised lazy bodies or NULL */
+	XML_Parser	 p; /* parser for lazy bodies or NULL */
+	struct artdate	**dates; /* formatted dates or NULL */
+	struct artsync	*sync; /* if shared by threads, or NULL */
+};
+
+/*
+ * Regular files smaller than this are mapped into memory and parsed in
+ * one go; anything else is read and parsed in chunks of INPUT_CHUNK.
+ */
+#ifndef	INPUT_MMAPMAX
+# define INPUT_MMAPMAX	(256 * 1024 * 1024)
+#endif
+#define	INPUT_CHUNK	(64 * 1024)
+
+/*
+ * A file opened for parsing with input_open(), or standard input if
+ * the name is "-".
+ */
+struct	input {
+	const char	*name; /* file name */
+	int		 fd; /* descriptor or -1 */
+	char		*map; /* mapped contents or NULL */
+	size_t		 mapsz; /* length of mapping */
+};
+
+/*
+ * Input file names in order (see srclist.c).
+ */
+struct	srclist {
+	char		**v; /* names */
+	size_t		  sz; /* number of names */
+	size_t		  max; /* allocated names */
+	struct arena	 *arena; /* storage for listed names or NULL */
+};
+
+/*
+ * A growable, nil-terminated string buffer.
+ * Zero-initialise before use; release with sbuf_free().
+ */
+struct	sbuf {
+	char		*p; /* buffer or NULL if never appended */
+	size_t		 sz; /* length of string */
+	size_t		 max; /* allocated size of buffer */
+};
+
+int	atom(XML_Parser p, const struct popts *po, 
+		const char *templ, int sz, char *src[], 
+		const char *dst, enum asort asort);
+int	json(XML_Parser p, const struct popts *po, int sz, 
 		char *src[], const char *dst, enum asort asort);
-int	json(XML_Parser p, int sz, 
+int	listtags(XML_Parser, const struct popts *, 
+		int, char *[], int, int);
+int	build(XML_Parser p, const struct popts *po,
+		const struct target *tgs, size_t tgsz, int sz,
+		char *src[], enum asort asort);
+int	target_parse(struct target *, const char *);
+void	target_free(struct target *);
+int	compile(XML_Parser p, const struct tmpl *t,
+		const char *src, const char *dst, const char *dir);
+int	compile_all(const struct popts *po, const struct tmpl *t,
+		int sz, char *src[], const char *dir);
+int	linkall(XML_Parser p, const struct popts *po, 
+		const char *templ, const char *force, int sz, 
 		char *src[], const char *dst, enum asort asort);
-int	listtags(XML_Parser, int, char *[], int, int);
-int	compile(XML_Parser p, const char *templ,
-		const char *src, const char *dst);
-int	linkall(XML_Parser p, const char *templ, const char *force, 
-		int sz, char *src[], const char *dst, enum asort asort);
-int	linkall_r(XML_Parser p, const char *templ, 
-		int sz, char *src[], enum asort asort);
+int	linkall_r(XML_Parser p, const struct popts *po, 
+		const char *templ, int sz, char *src[], 
+		const char *dir, enum asort asort);
+char	**linkall_dsts(struct artset *, enum asort);
+struct out *linkall_page(const struct tmpl *, struct artset *,
+		enum asort, char **, size_t, const char *);
+int	atom_exec(XML_Parser, const char *, struct artset *,
+		struct out *, const char *, enum asort);
+void	json_exec(struct out *, struct artset *, enum asort);
+void	listtags_exec(struct out *, struct artset *, int, int);
+
+int	sblg_parse_all(XML_Parser, const struct popts *, 
+		int, char *[], struct article **, size_t *);
+int	sblg_parse_body(XML_Parser, const struct article *, 
+		struct sbuf *);
+
+struct cache *cache_open(const char *, int, char *[]);
+int	cache_get(struct cache *, size_t, struct article **, size_t *);
+void	cache_set(struct cache *, size_t, const struct article *, size_t);
+void	cache_close(struct cache *);
+
+struct tmpl *tmpl_compile(XML_Parser, const char *, enum tmplmode);
+void	tmpl_exec(const struct tmpl *, struct out *, const char *,
+		struct artset *, enum asort, size_t, size_t, int,
+		const struct page *);
+void	tmpl_free(struct tmpl *);
+size_t	tmpl_page(const struct tmpl *, struct artset *, 
+		enum asort, size_t, size_t *);
+void	tmpl_prepare(const struct tmpl *, struct artset *, enum asort);
+size_t	tmpl_slots(const struct tmpl *);
+
+struct out *out_mem(const char *);
+struct out *out_open(const char *);
+int	out_close(struct out *);
+int	out_flush(struct out *);
+void	out_putc(struct out *, char);
+void	out_putll(struct out *, long long);
+void	out_puts(struct out *, const char *);
+void	out_write(struct out *, const char *, size_t);
+
+size_t	escspan(const char *, size_t, const char *);
+
+int	dateparse(const char *, time_t *, int *);
+void	datecache_free(struct artdate **, size_t);
+
+void	input_close(struct input *);
+int	input_open(struct input *, const char *);
+int	input_parse(struct input *, XML_Parser);
+
+int	mkparents(const char *);
+char	*outname(const char *);
+char	*outpath(const char *, const char *);
+char	*pagename(const char *, size_t);
 
 void	mmap_close(int fd, void *buf, size_t sz);
 int	mmap_open(const char *f, int *fd, char **buf, size_t *sz);
 
-void	xmlstrclose(char **, size_t *, const XML_Char *);
-void	xmlstrflush(char *, size_t *);
-void	xmlstropen(char **, size_t *, 
+void	srclist_argv(struct srclist *, int, char *[]);
+int	srclist_dir(struct srclist *, const char *, 
+		const char *const *, size_t, size_t);
+int	srclist_file(struct srclist *, const char *);
+void	srclist_free(struct srclist *);
+
+void	sbuf_append(struct sbuf *, const char *, size_t);
+void	sbuf_free(struct sbuf *);
+void	sbuf_putc(struct sbuf *, char);
+void	sbuf_puts(struct sbuf *, const char *);
+void	sbuf_reset(struct sbuf *);
+
+void	xmlstrclose(struct sbuf *, const XML_Char *);
+void	xmlstrescape(struct sbuf *, const char *);
+void	xmlstropen(struct sbuf *, 
 		const XML_Char *, const XML_Char **);
-void	xmlstrtext(char **, size_t *, const XML_Char *, int);
+void	xmlstrtext(struct sbuf *, const XML_Char *, int);
 
 int	xmlbool(const XML_Char *s);
-void	xmlclose(FILE *, const XML_Char *);
-void	xmlopen(FILE *, const XML_Char *, ...);
-void	xmlopens(FILE *, const XML_Char *, const XML_Char **);
-void	xmlopensx(FILE *, const XML_Char *, const XML_Char **, 
-		const char *, const struct article *, size_t, size_t);
-void	xmltextx(FILE *f, const XML_Char *s, 
-		const char *, const struct article *, size_t, size_t);
+void	xmlclose(struct out *, const XML_Char *);
+void	xmlopen(struct out *, const XML_Char *, ...);
+void	xmlopens(struct out *, const XML_Char *, const XML_Char **);
+int	xmlvoid(const XML_Char *);
+void	xmltextx(struct out *f, const XML_Char *s, const char *, 
+		struct artset *, const size_t *, size_t, 
+		const struct page *);
+void	xmltok(const char *, struct xmltok **, size_t *);
+void	xmltoksx(struct out *, const struct xmltok *, size_t,
+		const char *, struct artset *, const size_t *, size_t,
+		const struct page *);
 
-void	hashtag(char ***, size_t *, const char *);
-void	hashset(char ***, size_t *, const char *, const char *);
+void	hashtag(struct arena *, char ***, size_t *, const char *);
+void	hashset(struct arena *, char ***, 
+		size_t *, const char *, const char *);
+
+struct arena *arena_alloc(void);
+void	arena_free(struct arena *);
+void	*arena_malloc(struct arena *, size_t);
+void	arena_merge(struct arena *, struct arena *);
+char	*arena_strdup(struct arena *, const char *);
+char	*arena_strndup(struct arena *, const char *, size_t);
 
 void	*xcalloc(size_t, size_t);
 void	*xmalloc(size_t);
@@ -68,10 +360,49 @@ char	*xstrndup(const char *, size_t);
 void	*xrealloc(void *, size_t);
 void	*xreallocarray(void *, size_t, size_t);
 
-int	 datecmp(const void *, const void *);
-int	 rdatecmp(const void *, const void *);
-int	 filenamecmp(const void *, const void *);
-int	 cmdlinecmp(const void *, const void *);
+const char *artset_body(struct artset *, size_t);
+const struct artdate *artset_date(struct artset *, size_t);
+const char *artset_datefmt(struct artset *, size_t, 
+		const char *, size_t);
+void	 artset_free(struct artset *);
+void	 artset_lock(struct artset *);
+void	 artset_share(struct artset *);
+void	 artset_unlock(struct artset *);
+void	 artset_init(struct artset *, const struct article *, size_t);
+const size_t *artset_order(struct artset *, enum asort);
+const struct tagq *artset_tagq(struct artset *, enum asort, 
+		char **, size_t);
+const size_t *artset_tagged(struct artset *, size_t, size_t *);
+const char *artset_tagname(struct artset *, size_t);
+size_t	 artset_tagsz(struct artset *);
+
+size_t	 tagq_next(const struct tagq *, size_t);
+size_t	 tagq_nth(const struct tagq *, size_t);
+void	 tagidx_free(struct tagidx *);
+
+struct strmap *strmap_alloc(void);
+void	 strmap_free(struct strmap *);
+size_t	 strmap_get(const struct strmap *, const char *);
+const char *strmap_key(const struct strmap *, size_t);
+size_t	 strmap_put(struct strmap *, const char *);
+size_t	 strmap_size(const struct strmap *);
+
+struct stage *stage_alloc(const char *);
+void	 stage_add(struct stage *, size_t, double, double);
+void	 stage_free(struct stage *);
+void	 stage_print(const struct stage *, double);
+double	 stage_time(void);
+
+struct queue *queue_alloc(size_t, size_t);
+void	 queue_done(struct queue *);
+void	 queue_free(struct queue *);
+void	*queue_get(struct queue *, double *);
+void	 queue_put(struct queue *, void *, double *);
+
+struct writer *writer_alloc(size_t, size_t, struct stage *);
+void	 writer_done(struct writer *);
+int	 writer_free(struct writer *);
+void	 writer_put(struct writer *, struct out *, double *);
 
 __END_DECLS
 
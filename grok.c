@@ -23,7 +23,9 @@
 # include <err.h>
 #endif
 #include <expat.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,9 +35,30 @@
 
 #include "extern.h"
 
+/*
+ * Scratch buffers for the article being parsed.
+ * These are reused from article to article and copied into the arena
+ * once the article has been closed.
+ */
+struct	pbuf {
+	struct sbuf	  article;
+	struct sbuf	  title;
+	struct sbuf	  titletext;
+	struct sbuf	  author;
+	struct sbuf	  authortext;
+	struct sbuf	  aside;
+	struct sbuf	  asidetext;
+	char		**tagmap;
+	size_t		  tagmapsz;
+	char		**setmap;
+	size_t		  setmapsz;
+};
+
 struct	parse {
 	XML_Parser	  p;
 	struct article	 *article; /* article being parsed */
+	struct pbuf	  buf; /* scratch buffers for article */
+	struct arena	 *arena; /* arena of articles */
 	struct article	**articles;
 	size_t		 *articlesz;
 	size_t		  stack; /* stack (many uses) */
@@ -48,6 +71,46 @@ struct	parse {
 	unsigned int	  flags;
 	int		  fd; /* underlying descriptor */
 	const char	 *src; /* underlying file */
+	enum pbody	  body; /* article bodies (see popts) */
+	size_t		  bodyend; /* end of lazy article start tag */
+};
+
+/*
+ * Shared state of a threaded sblg_parse_all().
+ * Workers pull the next file index from "next" and record where each
+ * file's articles landed in "files" so that we can merge afterward.
+ */
+struct	pjob {
+	pthread_mutex_t	  mutex; /* protects next and failed */
+	char		**src; /* input files */
+	size_t		 *todo; /* indices of files to parse */
+	size_t		  todosz; /* number of todo */
+	size_t		  next; /* next todo to parse */
+	int		  failed; /* a file failed to parse */
+	enum pbody	  body; /* article bodies (see popts) */
+	struct pfile	 *files; /* per-file results */
+};
+
+/*
+ * Where a file's articles are found after parsing.
+ */
+struct	pfile {
+	size_t		  worker; /* index of parsing worker */
+	size_t		  start; /* first article in its vector */
+	size_t		  sz; /* number of articles */
+};
+
+/*
+ * A parse worker.
+ * Each has its own parser and article vector.
+ */
+struct	pworker {
+	pthread_t	  thread;
+	size_t		  id; /* index in worker array */
+	XML_Parser	  p; /* private parser */
+	struct article	 *arts; /* private article vector */
+	size_t		  artsz; /* length of arts */
+	struct pjob	 *job; /* shared state */
 };
 
 /*
@@ -81,13 +144,35 @@ logerr(const struct parse *p)
 	logerrx(p, "%s", XML_ErrorString(XML_GetErrorCode(p->p)));
 }
 
+/*
+ * The article body is accumulated through these, unless we're only
+ * after the metadata or its extent.
+ * In that case we still parse through the whole article, as the
+ * metadata (tags, images, dates, etc.) may be anywhere within it.
+ */
+static void
+body_open(struct parse *arg, const XML_Char *s, const XML_Char **atts)
+{
+
+	if (PBODY_FULL == arg->body)
+		xmlstropen(&arg->buf.article, s, atts);
+}
+
+static void
+body_close(struct parse *arg, const XML_Char *s)
+{
+
+	if (PBODY_FULL == arg->body)
+		xmlstrclose(&arg->buf.article, s);
+}
+
 static void
 article_text(void *dat, const XML_Char *s, int len)
 {
 	struct parse	*arg = dat;
 
-	xmlstrtext(&arg->article->article, 
-		&arg->article->articlesz, s, len);
+	if (PBODY_FULL == arg->body)
+		xmlstrtext(&arg->buf.article, s, len);
 }
 
 static void
@@ -95,10 +180,8 @@ title_text(void *dat, const XML_Char *s, int len)
 {
 	struct parse	*arg = dat;
 
-	xmlstrtext(&arg->article->title, 
-		&arg->article->titlesz, s, len);
-	xmlstrtext(&arg->article->titletext, 
-		&arg->article->titletextsz, s, len);
+	xmlstrtext(&arg->buf.title, s, len);
+	xmlstrtext(&arg->buf.titletext, s, len);
 	article_text(dat, s, len);
 }
 
@@ -107,10 +190,8 @@ addr_text(void *dat, const XML_Char *s, int len)
 {
 	struct parse	*arg = dat;
 
-	xmlstrtext(&arg->article->author, 
-		&arg->article->authorsz, s, len);
-	xmlstrtext(&arg->article->authortext, 
-		&arg->article->authortextsz, s, len);
+	xmlstrtext(&arg->buf.author, s, len);
+	xmlstrtext(&arg->buf.authortext, s, len);
 	article_text(dat, s, len);
 }
 
@@ -119,10 +200,8 @@ aside_text(void *dat, const XML_Char *s, int len)
 {
 	struct parse	*arg = dat;
 
-	xmlstrtext(&arg->article->aside, 
-		&arg->article->asidesz, s, len);
-	xmlstrtext(&arg->article->asidetext, 
-		&arg->article->asidetextsz, s, len);
+	xmlstrtext(&arg->buf.aside, s, len);
+	xmlstrtext(&arg->buf.asidetext, s, len);
 	article_text(dat, s, len);
 }
 
@@ -131,8 +210,7 @@ title_end(void *dat, const XML_Char *s)
 {
 	struct parse	*arg = dat;
 
-	xmlstrclose(&arg->article->article,
-		&arg->article->articlesz, s);
+	body_close(arg, s);
 
 	if (0 == strcasecmp(s, "h1") ||
 			0 == strcasecmp(s, "h2") ||
@@ -142,8 +220,7 @@ title_end(void *dat, const XML_Char *s)
 			article_begin, article_end);
 		XML_SetDefaultHandlerExpand(arg->p, article_text);
 	} else
-		xmlstrclose(&arg->article->title, 
-			&arg->article->titlesz, s);
+		xmlstrclose(&arg->buf.title, s);
 }
 
 static void
@@ -151,16 +228,14 @@ aside_end(void *dat, const XML_Char *s)
 {
 	struct parse	*arg = dat;
 
-	xmlstrclose(&arg->article->article,
-		&arg->article->articlesz, s);
+	body_close(arg, s);
 
 	if (0 == strcasecmp(s, "aside") && 0 == --arg->stack) {
 		XML_SetElementHandler(arg->p, 
 			article_begin, article_end);
 		XML_SetDefaultHandlerExpand(arg->p, article_text);
 	} else
-		xmlstrclose(&arg->article->aside, 
-			&arg->article->asidesz, s);
+		xmlstrclose(&arg->buf.aside, s);
 }
 
 static void
@@ -168,16 +243,14 @@ addr_end(void *dat, const XML_Char *s)
 {
 	struct parse	*arg = dat;
 
-	xmlstrclose(&arg->article->article,
-		&arg->article->articlesz, s);
+	body_close(arg, s);
 
 	if (0 == strcasecmp(s, "address") && 0 == --arg->stack) {
 		XML_SetElementHandler(arg->p, 
 			article_begin, article_end);
 		XML_SetDefaultHandlerExpand(arg->p, article_text);
 	} else
-		xmlstrclose(&arg->article->author, 
-			&arg->article->authorsz, s);
+		xmlstrclose(&arg->buf.author, s);
 }
 
 /*
@@ -194,16 +267,16 @@ tsearch(struct parse *arg, const XML_Char *s, const XML_Char **atts)
 			continue;
 		if (0 == strncasecmp(*attp, "data-sblg-set-", 14) &&
 		    '\0' != (*attp)[14]) {
-			hashset(&arg->article->setmap,
-			        &arg->article->setmapsz,
+			hashset(arg->arena, &arg->buf.setmap,
+			        &arg->buf.setmapsz,
 				*attp + 14, attp[1]);
 		} else if (0 == strcasecmp(*attp, "data-sblg-img")) {
-			free(arg->article->img);
-			arg->article->img = xstrdup(attp[1]);
+			arg->article->img = 
+				arena_strdup(arg->arena, attp[1]);
 			arg->flags |= PARSE_IMG;
 		} else if (0 == strcasecmp(*attp, "data-sblg-tags"))
-			hashtag(&arg->article->tagmap,
-				&arg->article->tagmapsz, attp[1]);
+			hashtag(arg->arena, &arg->buf.tagmap,
+				&arg->buf.tagmapsz, attp[1]);
 	}
 }
 
@@ -213,10 +286,8 @@ title_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	struct parse	*arg = dat;
 
 	arg->stack += 0 == strcasecmp(s, "title");
-	xmlstropen(&arg->article->title, 
-		&arg->article->titlesz, s, atts);
-	xmlstropen(&arg->article->article, 
-		&arg->article->articlesz, s, atts);
+	xmlstropen(&arg->buf.title, s, atts);
+	body_open(arg, s, atts);
 	tsearch(arg, s, atts);
 }
 
@@ -227,10 +298,8 @@ addr_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	struct parse	*arg = dat;
 
 	arg->stack += 0 == strcasecmp(s, "address");
-	xmlstropen(&arg->article->author, 
-		&arg->article->authorsz, s, atts);
-	xmlstropen(&arg->article->article, 
-		&arg->article->articlesz, s, atts);
+	xmlstropen(&arg->buf.author, s, atts);
+	body_open(arg, s, atts);
 	tsearch(arg, s, atts);
 }
 
@@ -240,10 +309,8 @@ aside_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	struct parse	*arg = dat;
 
 	arg->stack += 0 == strcasecmp(s, "aside");
-	xmlstropen(&arg->article->aside, 
-		&arg->article->asidesz, s, atts);
-	xmlstropen(&arg->article->article, 
-		&arg->article->articlesz, s, atts);
+	xmlstropen(&arg->buf.aside, s, atts);
+	body_open(arg, s, atts);
 	tsearch(arg, s, atts);
 }
 
@@ -257,14 +324,10 @@ article_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 {
 	struct parse	 *arg = dat;
 	const XML_Char	**attp;
-	struct tm	  tm;
-	char		 *erp;
-	size_t		  sz;
 
 	assert(0 == arg->stack);
 
-	xmlstropen(&arg->article->article,
-		&arg->article->articlesz, s, atts);
+	body_open(arg, s, atts);
 	tsearch(arg, s, atts);
 
 	if (0 == strcasecmp(s, "aside")) {
@@ -282,7 +345,8 @@ article_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 				break;
 		if (NULL != attp[0] && 
 		    NULL != attp[1] && '\0' != *attp[1]) {
-			arg->article->img = xstrdup(attp[1]);
+			arg->article->img = 
+				arena_strdup(arg->arena, attp[1]);
 			arg->flags |= PARSE_IMG;
 		}
 	} else if (0 == strcasecmp(s, "time")) {
@@ -292,30 +356,11 @@ article_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 		for (attp = atts; NULL != *attp; attp += 2) {
 			if (strcasecmp(attp[0], "datetime"))
 				continue;
-			memset(&tm, 0, sizeof(struct tm));
-			sz = strlen(attp[1]);
-			if (10 == sz) {
-				erp = strptime(attp[1], "%F", &tm);
-				if (NULL == erp || '\0' != *erp) {
-					logerrx(arg, "malformed "
-						"ISO 3339 date");
-					continue;
-				}
-				arg->article->isdatetime = 0;
-			} else if (20 == sz) {
-				erp = strptime(attp[1], "%FT%TZ", &tm);
-				if (NULL == erp || '\0' != *erp) {
-					logerrx(arg, "malformed "
-						"ISO 3339 datetime");
-					continue;
-				}
-				arg->article->isdatetime = 1;
-			} else {
-				logerrx(arg, "malformed "
-					"ISO 3339 datetime");
-				continue;
-			}
-			arg->article->time = timegm(&tm);
+			if ( ! dateparse(attp[1], &arg->article->time,
+			    &arg->article->isdatetime))
+				logerrx(arg, "malformed RFC 3339 %s",
+					10 == strlen(attp[1]) ? 
+					"date" : "datetime");
 		}
 	} else if (0 == strcasecmp(s, "address")) {
 		if (PARSE_ADDR & arg->flags) 
@@ -338,15 +383,36 @@ article_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 		arg->gstack++;
 }
 
+/*
+ * Copy the scratch buffer "buf" into the arena as "p" of length "psz",
+ * then reset the buffer for the next article.
+ * If the buffer is NULL or empty, use "def" instead, which may be NULL.
+ */
+static void
+commit(struct parse *arg, char **p, size_t *psz, 
+	struct sbuf *buf, const char *def)
+{
+
+	if (NULL == buf || 0 == buf->sz) {
+		*p = NULL == def ? NULL : arena_strdup(arg->arena, def);
+		*psz = NULL == def ? 0 : strlen(def);
+		return;
+	}
+
+	*p = arena_strndup(arg->arena, buf->p, buf->sz);
+	*psz = buf->sz;
+	sbuf_reset(buf);
+}
+
 static void
 article_end(void *dat, const XML_Char *s)
 {
 	struct parse	*arg = dat;
 	char		*cp;
 	struct stat	 st;
+	size_t		 end;
 
-	xmlstrclose(&arg->article->article,
-		&arg->article->articlesz, s);
+	body_close(arg, s);
 
 	if (strcasecmp(s, "article") || --arg->gstack > 0) 
 		return;
@@ -354,6 +420,14 @@ article_end(void *dat, const XML_Char *s)
 	XML_SetElementHandler(arg->p, input_begin, NULL);
 	XML_SetDefaultHandlerExpand(arg->p, NULL);
 
+	if (PBODY_LAZY == arg->body) {
+		end = XML_GetCurrentByteIndex(arg->p) + 
+			XML_GetCurrentByteCount(arg->p);
+		if (end < arg->bodyend)
+			end = arg->bodyend;
+		arg->article->bodysz = end - arg->article->bodyoff;
+	}
+
 	if (NULL != (cp = strrchr(arg->article->base, '.')))
 		if (NULL == strchr(cp, '/'))
 			*cp = '\0';
@@ -364,28 +438,80 @@ article_end(void *dat, const XML_Char *s)
 		if (NULL == strchr(cp, '/'))
 			*cp = '\0';
 
-	if (NULL == arg->article->title) {
-		assert(NULL == arg->article->titletext);
-		arg->article->title = 
-			xstrdup("Untitled article");
-		arg->article->titlesz = 
-			strlen(arg->article->title);
-		arg->article->titletext = 
-			xstrdup("Untitled article");
-		arg->article->titletextsz = 
-			strlen(arg->article->titletext);
+	/*
+	 * Move our scratch buffers into the arena.
+	 * If the title, author, or aside weren't specified, use the
+	 * defaults as documented.
+	 * If they were but have only markup, their text is NULL.
+	 */
+
+	if (0 == arg->buf.title.sz) {
+		commit(arg, &arg->article->title, 
+			&arg->article->titlesz, 
+			NULL, "Untitled article");
+		commit(arg, &arg->article->titletext, 
+			&arg->article->titletextsz, 
+			NULL, "Untitled article");
+	} else {
+		commit(arg, &arg->article->title, 
+			&arg->article->titlesz, &arg->buf.title, NULL);
+		commit(arg, &arg->article->titletext, 
+			&arg->article->titletextsz, 
+			&arg->buf.titletext, NULL);
+	}
+
+	if (0 == arg->buf.author.sz) {
+		commit(arg, &arg->article->author, 
+			&arg->article->authorsz, 
+			NULL, "Untitled author");
+		commit(arg, &arg->article->authortext, 
+			&arg->article->authortextsz, 
+			NULL, "Untitled author");
+	} else {
+		commit(arg, &arg->article->author, 
+			&arg->article->authorsz, &arg->buf.author, NULL);
+		commit(arg, &arg->article->authortext, 
+			&arg->article->authortextsz, 
+			&arg->buf.authortext, NULL);
+	}
+
+	if (0 == arg->buf.aside.sz) {
+		commit(arg, &arg->article->aside, 
+			&arg->article->asidesz, NULL, "");
+		commit(arg, &arg->article->asidetext, 
+			&arg->article->asidetextsz, NULL, "");
+	} else {
+		commit(arg, &arg->article->aside, 
+			&arg->article->asidesz, &arg->buf.aside, NULL);
+		commit(arg, &arg->article->asidetext, 
+			&arg->article->asidetextsz, 
+			&arg->buf.asidetext, NULL);
 	}
-	if (NULL == arg->article->author) {
-		assert(NULL == arg->article->authortext);
-		arg->article->author = 
-			xstrdup("Untitled author");
-		arg->article->authorsz = 
-			strlen(arg->article->author);
-		arg->article->authortext = 
-			xstrdup("Untitled author");
-		arg->article->authortextsz = 
-			strlen(arg->article->authortext);
+	if (PBODY_FULL == arg->body)
+		commit(arg, &arg->article->article, 
+			&arg->article->articlesz, &arg->buf.article, NULL);
+	else if (PBODY_NONE == arg->body)
+		commit(arg, &arg->article->article, 
+			&arg->article->articlesz, NULL, "");
+
+	if (arg->buf.tagmapsz > 0) {
+		arg->article->tagmap = arena_malloc(arg->arena,
+			arg->buf.tagmapsz * sizeof(char *));
+		memcpy(arg->article->tagmap, arg->buf.tagmap,
+			arg->buf.tagmapsz * sizeof(char *));
+		arg->article->tagmapsz = arg->buf.tagmapsz;
+		arg->buf.tagmapsz = 0;
 	}
+
+	if (arg->buf.setmapsz > 0) {
+		arg->article->setmap = arena_malloc(arg->arena,
+			arg->buf.setmapsz * sizeof(char *));
+		memcpy(arg->article->setmap, arg->buf.setmap,
+			arg->buf.setmapsz * sizeof(char *));
+		arg->article->setmapsz = arg->buf.setmapsz;
+		arg->buf.setmapsz = 0;
+	}
+
 	if (0 == arg->article->time) {
 		arg->article->isdatetime = 1;
 		if (-1 == fstat(arg->fd, &st))
@@ -393,13 +519,6 @@ article_end(void *dat, const XML_Char *s)
 		else
 			arg->article->time = st.st_ctime;
 	}
-	if (NULL == arg->article->aside) {
-		assert(NULL == arg->article->asidetext);
-		arg->article->aside = xstrdup("");
-		arg->article->asidetext = xstrdup("");
-		arg->article->asidesz =
-			arg->article->asidetextsz = 0;
-	}
 }
 
 /*
@@ -450,25 +569,31 @@ input_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	(*arg->articlesz)++;
 	memset(arg->article, 0, sizeof(struct article));
 
+	if (NULL == arg->arena)
+		arg->arena = arena_alloc();
+
+	arg->article->arena = arg->arena;
 	arg->article->order = *arg->articlesz;
 	arg->article->src = arg->src;
-	arg->article->base = xstrdup(arg->src);
+	arg->article->base = arena_strdup(arg->arena, arg->src);
 
 	if (NULL == strrchr(arg->src, '/')) {
-		arg->article->stripbase = xstrdup(arg->src);
+		arg->article->stripbase = 
+			arena_strdup(arg->arena, arg->src);
 		arg->article->stripsrc = arg->src;
 	} else {
-		arg->article->stripbase = xstrdup
-			(strrchr(arg->src, '/') + 1);
+		arg->article->stripbase = arena_strdup
+			(arg->arena, strrchr(arg->src, '/') + 1);
 		arg->article->stripsrc = 
 			strrchr(arg->src, '/') + 1;
 	}
 
 	if (NULL == strrchr(arg->src, '/'))
-		arg->article->striplangbase = xstrdup(arg->src);
+		arg->article->striplangbase = 
+			arena_strdup(arg->arena, arg->src);
 	else
-		arg->article->striplangbase = xstrdup
-			(strrchr(arg->src, '/') + 1);
+		arg->article->striplangbase = arena_strdup
+			(arg->arena, strrchr(arg->src, '/') + 1);
 
 	/*
 	 * If we have any languages specified, append them here.
@@ -499,47 +624,365 @@ input_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 				arg->article->sort = SORT_LAST;
 		}
 
+	if (PBODY_LAZY == arg->body) {
+		arg->article->bodyoff = XML_GetCurrentByteIndex(arg->p);
+		arg->bodyend = arg->article->bodyoff + 
+			XML_GetCurrentByteCount(arg->p);
+	}
+
 	arg->gstack = 1;
-	xmlstropen(&arg->article->article, 
-		&arg->article->articlesz, s, atts);
+	body_open(arg, s, atts);
 	XML_SetElementHandler(arg->p, article_begin, article_end);
 	XML_SetDefaultHandlerExpand(arg->p, article_text);
 	tsearch(arg, s, atts);
 }
 
-int
-sblg_parse(XML_Parser p, const char *src, 
+/*
+ * Lazy bodies are re-parsed on their own, so they can't depend on
+ * anything earlier in the document: an encoding or document type.
+ * If we see either, keep this file's bodies in full.
+ */
+static void
+lazy_xmldecl(void *dat, const XML_Char *version,
+	const XML_Char *encoding, int standalone)
+{
+	struct parse	*arg = dat;
+
+	if (NULL != encoding && strcasecmp(encoding, "UTF-8"))
+		arg->body = PBODY_FULL;
+}
+
+static void
+lazy_doctype(void *dat, const XML_Char *name, 
+	const XML_Char *sysid, const XML_Char *pubid, int subset)
+{
+	struct parse	*arg = dat;
+
+	arg->body = PBODY_FULL;
+}
+
+/*
+ * Parse "src" into "arg", appending as in sblg_parse().
+ * Article bodies are kept as given by "body".
+ */
+static int
+parse_file(XML_Parser p, const char *src, enum pbody body,
 	struct article **arg, size_t *argsz)
 {
-	char		*buf;
-	size_t		 sz;
-	int		 fd, rc;
+	struct input	 in;
+	int		 c, rc;
 	struct parse	 parse;
 
 	memset(&parse, 0, sizeof(struct parse));
 
 	rc = 0;
 
-	if ( ! mmap_open(src, &fd, &buf, &sz))
+	if ( ! input_open(&in, src))
 		goto out;
 
 	parse.articles = arg;
 	parse.articlesz = argsz;
 	parse.src = src;
 	parse.p = p;
-	parse.fd = fd;
+	parse.fd = in.fd;
+	parse.body = body;
+
+	/* All articles in a vector share an arena. */
+
+	if (*argsz > 0)
+		parse.arena = (*arg)[0].arena;
 
 	XML_ParserReset(p, NULL);
 	XML_SetStartElementHandler(p, input_begin);
 	XML_SetUserData(p, &parse);
 
-	if (XML_STATUS_OK != XML_Parse(p, buf, (int)sz, 1)) {
-		logerr(&parse);
+	/* 
+	 * Lazy bodies are read back from the mapping's file, so
+	 * streamed input must be kept in full.
+	 * A byte-order mark means UTF-16.
+	 */
+
+	if (PBODY_LAZY == body && NULL == in.map)
+		parse.body = PBODY_FULL;
+	else if (PBODY_LAZY == body) {
+		XML_SetXmlDeclHandler(p, lazy_xmldecl);
+		XML_SetStartDoctypeDeclHandler(p, lazy_doctype);
+		if (in.mapsz >= 2 && 
+		    (('\xfe' == in.map[0] && '\xff' == in.map[1]) ||
+		     ('\xff' == in.map[0] && '\xfe' == in.map[1])))
+			parse.body = PBODY_FULL;
+	}
+
+	if ((c = input_parse(&in, p)) <= 0) {
+		if (0 == c)
+			logerr(&parse);
 		goto out;
 	} 
 
 	rc = 1;
 out:
-	mmap_close(fd, buf, sz);
+	input_close(&in);
+	sbuf_free(&parse.buf.article);
+	sbuf_free(&parse.buf.title);
+	sbuf_free(&parse.buf.titletext);
+	sbuf_free(&parse.buf.author);
+	sbuf_free(&parse.buf.authortext);
+	sbuf_free(&parse.buf.aside);
+	sbuf_free(&parse.buf.asidetext);
+	free(parse.buf.tagmap);
+	free(parse.buf.setmap);
+	return(rc);
+}
+
+int
+sblg_parse(XML_Parser p, const char *src, 
+	struct article **arg, size_t *argsz)
+{
+
+	return(parse_file(p, src, PBODY_FULL, arg, argsz));
+}
+
+static void
+body_begin(void *dat, const XML_Char *s, const XML_Char **atts)
+{
+
+	xmlstropen(dat, s, atts);
+}
+
+static void
+body_end(void *dat, const XML_Char *s)
+{
+
+	xmlstrclose(dat, s);
+}
+
+static void
+body_text(void *dat, const XML_Char *s, int len)
+{
+
+	xmlstrtext(dat, s, len);
+}
+
+/*
+ * Fill "buf" with the body of "art", which was parsed lazily (see
+ * PBODY_LAZY), by parsing its extent in the source again.
+ * The body is serialised just as if we'd kept it the first time.
+ * Returns zero on failure (having reported it).
+ */
+int
+sblg_parse_body(XML_Parser p, const struct article *art, 
+	struct sbuf *buf)
+{
+	char		*map;
+	size_t		 sz;
+	int		 fd, rc = 0;
+
+	if ( ! mmap_open(art->src, &fd, &map, &sz))
+		return(0);
+
+	if (art->bodyoff + art->bodysz > sz) {
+		warnx("%s: changed while being read", art->src);
+		goto out;
+	}
+
+	XML_ParserReset(p, NULL);
+	XML_SetElementHandler(p, body_begin, body_end);
+	XML_SetDefaultHandlerExpand(p, body_text);
+	XML_SetUserData(p, buf);
+
+	if (XML_STATUS_OK != XML_Parse(p, 
+	    map + art->bodyoff, (int)art->bodysz, 1)) {
+		warnx("%s: %s", art->src, 
+			XML_ErrorString(XML_GetErrorCode(p)));
+		goto out;
+	}
+
+	rc = 1;
+out:
+	mmap_close(fd, map, sz);
+	return(rc);
+}
+
+static void *
+parse_worker(void *dat)
+{
+	struct pworker	*w = dat;
+	struct pjob	*job = w->job;
+	size_t		 i, start;
+
+	for (;;) {
+		pthread_mutex_lock(&job->mutex);
+		i = job->failed ? job->todosz : job->next++;
+		pthread_mutex_unlock(&job->mutex);
+		if (i >= job->todosz)
+			break;
+
+		i = job->todo[i];
+		start = w->artsz;
+		if ( ! parse_file(w->p, job->src[i], 
+		    job->body, &w->arts, &w->artsz)) {
+			pthread_mutex_lock(&job->mutex);
+			job->failed = 1;
+			pthread_mutex_unlock(&job->mutex);
+			break;
+		}
+
+		job->files[i].worker = w->id;
+		job->files[i].start = start;
+		job->files[i].sz = w->artsz - start;
+	}
+
+	return(NULL);
+}
+
+/*
+ * Parse all input files "src" of length "sz" into "arg", appending as
+ * in sblg_parse().
+ * If we've been asked for multiple jobs, this spreads the files over
+ * worker threads (each with its own parser), then merges the results
+ * in file order so that the "order" of each article is exactly as if
+ * we'd parsed serially.
+ * If we have a cache, unchanged files are read from it instead of being
+ * parsed, and newly-parsed files are added to it.
+ * Files whose bodies aren't kept in full (see struct popts) are not
+ * cached.
+ * Returns zero on failure (having already reported it).
+ */
+int
+sblg_parse_all(XML_Parser p, const struct popts *po, 
+	int sz, char *src[], struct article **arg, size_t *argsz)
+{
+	struct pjob	 job;
+	struct pworker	*w = NULL;
+	struct cache	*c = NULL;
+	struct arena	*a;
+	size_t		 i, j, wsz = 0, nthreads, total, start;
+	int		 er, rc = 0;
+
+	memset(&job, 0, sizeof(struct pjob));
+
+	if (NULL != po->cache)
+		c = cache_open(po->cache, sz, src);
+
+	if (po->jobs <= 1 || sz <= 1) {
+		for (i = 0; i < (size_t)sz; i++) {
+			if (NULL != c && cache_get(c, i, arg, argsz))
+				continue;
+			start = *argsz;
+			if ( ! parse_file(p, src[i], po->body, arg, argsz))
+				goto out;
+			if (NULL != c && PBODY_FULL == po->body)
+				cache_set(c, i, 
+					&(*arg)[start], *argsz - start);
+		}
+		rc = 1;
+		goto out;
+	}
+
+	/*
+	 * The last "worker" never runs: it holds the articles we've
+	 * pulled from the cache.
+	 * The remaining files are queued for the real workers.
+	 */
+
+	wsz = po->jobs < (size_t)sz ? po->jobs : (size_t)sz;
+	w = xcalloc(wsz + 1, sizeof(struct pworker));
+
+	job.src = src;
+	job.body = po->body;
+	job.files = xcalloc(sz, sizeof(struct pfile));
+	job.todo = xcalloc(sz, sizeof(size_t));
+
+	for (i = 0; i < (size_t)sz; i++) {
+		start = w[wsz].artsz;
+		if (NULL != c && 
+		    cache_get(c, i, &w[wsz].arts, &w[wsz].artsz)) {
+			job.files[i].worker = wsz;
+			job.files[i].start = start;
+			job.files[i].sz = w[wsz].artsz - start;
+		} else
+			job.todo[job.todosz++] = i;
+	}
+
+	nthreads = wsz < job.todosz ? wsz : job.todosz;
+
+	if (0 != (er = pthread_mutex_init(&job.mutex, NULL))) {
+		errno = er;
+		err(EXIT_FAILURE, "pthread_mutex_init");
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		w[i].id = i;
+		w[i].job = &job;
+		if (NULL == (w[i].p = XML_ParserCreate(NULL)))
+			err(EXIT_FAILURE, "XML_ParserCreate");
+		er = pthread_create(&w[i].thread, 
+			NULL, parse_worker, &w[i]);
+		if (0 != er) {
+			errno = er;
+			err(EXIT_FAILURE, "pthread_create");
+		}
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(w[i].thread, NULL);
+		XML_ParserFree(w[i].p);
+	}
+
+	pthread_mutex_destroy(&job.mutex);
+
+	if (job.failed) {
+		for (i = 0; i <= wsz; i++)
+			sblg_free(w[i].arts, w[i].artsz);
+		goto out;
+	}
+
+	/* 
+	 * Merge in command-line order.
+	 * The article contents are moved, so only free the vectors.
+	 * All arenas are merged into one, as sblg_free() expects.
+	 */
+
+	a = *argsz > 0 ? (*arg)[0].arena : NULL;
+	for (i = 0; i <= wsz; i++) {
+		if (0 == w[i].artsz)
+			continue;
+		if (NULL == a)
+			a = w[i].arts[0].arena;
+		else
+			arena_merge(a, w[i].arts[0].arena);
+	}
+
+	for (total = 0, i = 0; i < (size_t)sz; i++)
+		total += job.files[i].sz;
+
+	if (total > 0)
+		*arg = xreallocarray(*arg, 
+			*argsz + total, sizeof(struct article));
+
+	for (i = 0; i < (size_t)sz; i++) {
+		memcpy(&(*arg)[*argsz], 
+			&w[job.files[i].worker].arts[job.files[i].start],
+			job.files[i].sz * sizeof(struct article));
+		start = *argsz;
+		for (j = 0; j < job.files[i].sz; j++) {
+			(*arg)[*argsz].order = *argsz + 1;
+			(*arg)[*argsz].arena = a;
+			(*argsz)++;
+		}
+		if (NULL != c && PBODY_FULL == po->body && 
+		    job.files[i].worker < wsz)
+			cache_set(c, i, 
+				&(*arg)[start], *argsz - start);
+	}
+
+	for (i = 0; i <= wsz; i++)
+		free(w[i].arts);
+	rc = 1;
+out:
+	cache_close(c);
+	free(w);
+	free(job.files);
+	free(job.todo);
 	return(rc);
 }
@@ -33,176 +33,189 @@
 #include "extern.h"
 
 static void
-json_quoted(const char *cp, FILE *f)
+json_quoted(const char *cp, struct out *f)
 {
-	char	 c;
+	size_t	 sz, n;
 
-	fputc('"', f);
-	while ('\0' != (c = *cp++))
-		switch (c) {
+	out_putc(f, '"');
+	for (sz = strlen(cp); sz > 0; cp++, sz--) {
+		n = escspan(cp, sz, "\"\\/\b\f\n\r\t");
+		out_write(f, cp, n);
+		if (0 == (sz -= n))
+			break;
+		cp += n;
+		switch (*cp) {
 		case ('"'):
 		case ('\\'):
 		case ('/'):
-			fputc('\\', f);
-			fputc(c, f);
+			out_putc(f, '\\');
+			out_putc(f, *cp);
 			break;
 		case ('\b'):
-			fputs("\\b", f);
+			out_puts(f, "\\b");
 			break;
 		case ('\f'):
-			fputs("\\f", f);
+			out_puts(f, "\\f");
 			break;
 		case ('\n'):
-			fputs("\\n", f);
+			out_puts(f, "\\n");
 			break;
 		case ('\r'):
-			fputs("\\r", f);
-			break;
-		case ('\t'):
-			fputs("\\t", f);
+			out_puts(f, "\\r");
 			break;
 		default:
-			fputc(c, f);
+			out_puts(f, "\\t");
 			break;
 		}
-	fputc('"', f);
+	}
+	out_putc(f, '"');
 }
 
 static void
-json_time(const char *key, time_t t, FILE *f)
+json_time(const char *key, time_t t, struct out *f)
 {
 
 	json_quoted(key, f);
-	fputc(':', f);
-	fprintf(f, "%lld", (long long)t);
+	out_putc(f, ':');
+	out_putll(f, (long long)t);
 }
 
 static void
-json_text(const char *key, const char *text, FILE *f)
+json_text(const char *key, const char *text, struct out *f)
 {
 
 	json_quoted(key, f);
-	fputc(':', f);
+	out_putc(f, ':');
 	json_quoted(text, f);
 }
 
 static void
 json_textxml(const char *key, 
-	const char *text, const char *xml, FILE *f)
+	const char *text, const char *xml, struct out *f)
 {
 
 	json_quoted(key, f);
-	fputc(':', f);
-	fputc('{', f);
+	out_putc(f, ':');
+	out_putc(f, '{');
 	if (NULL != text) {
 		json_quoted("text", f);
-		fputc(':', f);
+		out_putc(f, ':');
 		json_quoted(text, f);
-		fputc(',', f);
+		out_putc(f, ',');
 	}
 	json_quoted("xml", f);
-	fputc(':', f);
+	out_putc(f, ':');
 	json_quoted(xml, f);
-	fputc('}', f);
+	out_putc(f, '}');
 }
 
 static void
-json_textlist(const char *key, char **tags, size_t tagsz, FILE *f)
+json_textlist(const char *key, char **tags, size_t tagsz, struct out *f)
 {
 	size_t	 i;
 	
 	json_quoted("tags", f);
-	fputc(':', f);
-	fputc('[', f);
+	out_putc(f, ':');
+	out_putc(f, '[');
 
 	for (i = 0; i < tagsz; i++) {
 		if (i > 0)
-			fputc(',', f);
+			out_putc(f, ',');
 		json_quoted(tags[i], f);
 	}
 
-	fputc(']', f);
+	out_putc(f, ']');
 }
 
-int
-json(XML_Parser p, int sz, char *src[], const char *dst, enum asort asort)
+/*
+ * Emit the articles in "set" to "f" in order "asort" as JSON.
+ */
+void
+json_exec(struct out *f, struct artset *set, enum asort asort)
 {
-	size_t		 j, sargsz;
-	int		 i, rc;
-	FILE		*f;
-	struct article	*sargs;
+	size_t		 j, sargsz = set->artsz;
+	const struct article *sargs = set->arts, *art;
+	const size_t	*perm;
 
-	rc = 0;
-	f = NULL;
-
-	sargs = NULL;
-	sargsz = 0;
-
-	for (i = 0; i < sz; i++)
-		if ( ! sblg_parse(p, src[i], &sargs, &sargsz))
-			goto out;
-
-	if (ASORT_DATE == asort)
-		qsort(sargs, sargsz, sizeof(struct article), datecmp);
-	if (ASORT_RDATE == asort)
-		qsort(sargs, sargsz, sizeof(struct article), rdatecmp);
-	else if (ASORT_FILENAME == asort)
-		qsort(sargs, sargsz, sizeof(struct article), filenamecmp);
-
-	f = stdout;
-	if (strcmp(dst, "-") && NULL == (f = fopen(dst, "w"))) {
-		warn("%s", dst);
-		goto out;
-	}
+	perm = artset_order(set, asort);
 
-	fputc('{', f);
+	out_putc(f, '{');
 	json_text("version", VERSION, f);
-	fputc(',', f);
+	out_putc(f, ',');
 	json_quoted("articles", f);
-	fputs(": [", f);
+	out_puts(f, ": [");
 
 	for (j = 0; j < sargsz; j++) {
-		fputc('{', f);
-		json_text("src", sargs[j].src, f);
-		fputc(',', f);
-		json_text("base", sargs[j].base, f);
-		fputc(',', f);
+		art = &sargs[perm[j]];
+		out_putc(f, '{');
+		json_text("src", art->src, f);
+		out_putc(f, ',');
+		json_text("base", art->base, f);
+		out_putc(f, ',');
 		json_text("stripbase", 
-			sargs[j].stripbase, f);
-		fputc(',', f);
+			art->stripbase, f);
+		out_putc(f, ',');
 		json_text("striplangbase", 
-			sargs[j].striplangbase, f);
-		fputc(',', f);
-		json_time("time", sargs[j].time, f);
-		fputc(',', f);
+			art->striplangbase, f);
+		out_putc(f, ',');
+		json_time("time", art->time, f);
+		out_putc(f, ',');
 		json_textxml("title", 
-			sargs[j].titletext, 
-			sargs[j].title, f);
-		fputc(',', f);
+			art->titletext, 
+			art->title, f);
+		out_putc(f, ',');
 		json_textxml("aside", 
-			sargs[j].asidetext, 
-			sargs[j].aside, f);
-		fputc(',', f);
+			art->asidetext, 
+			art->aside, f);
+		out_putc(f, ',');
 		json_textxml("author", 
-			sargs[j].authortext, 
-			sargs[j].author, f);
-		fputc(',', f);
+			art->authortext, 
+			art->author, f);
+		out_putc(f, ',');
 		json_textxml("article", NULL,
-			sargs[j].article, f);
-		fputc(',', f);
-		json_textlist("tags", sargs[j].tagmap, 
-			sargs[j].tagmapsz, f);
-		fputc('}', f);
+			art->article, f);
+		out_putc(f, ',');
+		json_textlist("tags", art->tagmap, 
+			art->tagmapsz, f);
+		out_putc(f, '}');
 		if (j < sargsz - 1)
-			fputc(',', f);
+			out_putc(f, ',');
 	}
-	fputs("]}\n", f);
+	out_puts(f, "]}\n");
+}
+
+int
+json(XML_Parser p, const struct popts *po, int sz, 
+	char *src[], const char *dst, enum asort asort)
+{
+	size_t		 sargsz;
+	int		 rc;
+	struct out	*f;
+	struct article	*sargs;
+	struct artset	 set;
+
+	rc = 0;
+	f = NULL;
+
+	sargs = NULL;
+	sargsz = 0;
+	artset_init(&set, NULL, 0);
+
+	if ( ! sblg_parse_all(p, po, sz, src, &sargs, &sargsz))
+		goto out;
+
+	artset_init(&set, sargs, sargsz);
+
+	if (NULL == (f = out_open(dst)))
+		goto out;
 
+	json_exec(f, &set, asort);
 	rc = 1;
 out:
+	artset_free(&set);
 	sblg_free(sargs, sargsz);
-	if (NULL != f && stdout != f)
-		fclose(f);
+	if ( ! out_close(f))
+		rc = 0;
 	return(rc);
 }
 
@@ -20,8 +20,10 @@
 #if HAVE_ERR
 # include <err.h>
 #endif
+#include <errno.h>
 #include <expat.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,477 +32,59 @@
 
 #include "extern.h"
 
-struct	linkall {
-	FILE		 *f; /* open template file */
-	const char	 *src; /* template file */
-	const char	 *dst; /* output file (or empty)*/
-	XML_Parser	  p; /* active parser */
-	struct article	 *sargs; /* sorted article contents */
-	size_t		  spos; /* current sarg being shown */ 
-	size_t		  sposz; /* size of sargs */
-	size_t		  ssposz;  /* number of sargs to show */
-	size_t		  stack; /* temporary: tag stack size */
-	size_t		  navstart; /* temporary: nav items to show */
-	size_t		  navlen; /* temporary: nav items to show */
-	char		**navtags; /* list of navtags to query */
-	size_t		  navtagsz; /* size of navtags list */
-	int		  navuse; /* use navigation contents */
-	enum asort	  navsort; /* override sort order */
-	int		  usesort; /* whether to use navsort */
-	int		  navxml; /* don't print html elements */
-	ssize_t		  single; /* page index in -C mode*/
-	char		 *nav; /* temporary: nav buffer */
-	size_t		  navsz; /* nav buffer length */
-	char		 *buf; /* buffer for text */
-	size_t		  bufsz; /* buffer size */
-	size_t		  bufmax; /* buffer maximum size */
-};
-
-static	void	tmpl_begin(void *dat, const XML_Char *s, 
-			const XML_Char **atts);
-
-static void
-tmpl_text(void *dat, const XML_Char *s, int len)
-{
-	struct linkall	*arg = dat;
-
-	if (-1 != arg->single)
-		xmlstrtext(&arg->buf, &arg->bufsz, s, len);
-	else
-		fprintf(arg->f, "%.*s", len, s);
-}
-
-static void
-tmpl_end(void *dat, const XML_Char *s)
-{
-	struct linkall	*arg = dat;
-
-	if (-1 != arg->single) {
-		xmltextx(arg->f, arg->buf, arg->dst, 
-			arg->sargs, arg->sposz, arg->single);
-		xmlstrflush(arg->buf, &arg->bufsz);
-	}
-
-	xmlclose(arg->f, s);
-}
-
-static void
-article_begin(void *dat, const XML_Char *s, const XML_Char **atts)
-{
-	struct linkall	*arg = dat;
-
-	arg->stack += 0 == strcasecmp(s, "article");
-}
-
-static void
-nav_text(void *dat, const XML_Char *s, int len)
-{
-	struct linkall	*arg = dat;
-
-	xmlstrtext(&arg->nav, &arg->navsz, s, len);
-}
-
-static void
-nav_begin(void *dat, const XML_Char *s, const XML_Char **atts)
-{
-	struct linkall	*arg = dat;
-
-	arg->stack += 0 == strcasecmp(s, "nav");
-	xmlstropen(&arg->nav, &arg->navsz, s, atts);
-}
-
-/*
- * Find at least one of the given "tags" in "tagmap".
- * If "tags" is NULL or the tag was found, return 1.
- * If "tagmap" is empty or the tag wasn't found, return 0.
- */
-static int
-tagfind(char **tags, size_t tagsz, char **tagmap, size_t tagmapsz)
-{
-	size_t	 	 i, j;
-
-	if (0 == tagsz)
-		return(1);
-	if (0 == tagmapsz) 
-		return(0);
-
-	for (i = 0; i < tagsz; i++) 
-		for (j = 0; j < tagmapsz; j++) 
-			if (0 == strcmp(tags[i], tagmap[j]))
-				return(1);
-
-	return(0);
-}
-
-static void
-nav_end(void *dat, const XML_Char *s)
-{
-	struct linkall	*arg = dat;
-	size_t		 i, j, k;
-	char		 buf[32]; 
-	int		 rc;
-	struct article	*sv = NULL;
-
-	if (strcasecmp(s, "nav") || 0 != --arg->stack) {
-		xmlstrclose(&arg->nav, &arg->navsz, s);
-		return;
-	}
-
-	XML_SetElementHandler(arg->p, tmpl_begin, tmpl_end);
-	XML_SetDefaultHandlerExpand(arg->p, tmpl_text);
-
-	/* Only open the <ul> if we're printing HTML content. */
-
-	if ( ! arg->navxml) {
-		fputc('\n', arg->f);
-		xmlopen(arg->f, "ul", NULL);
-		fputc('\n', arg->f);
-	}
-
-	if (arg->usesort) {
-		sv = arg->sargs;
-		arg->sargs = calloc(arg->sposz, sizeof(struct article));
-		memcpy(arg->sargs, sv, arg->sposz * sizeof(struct article));
-		if (ASORT_DATE == arg->navsort)
-			qsort(arg->sargs, arg->sposz, 
-				sizeof(struct article), datecmp);
-		else if (ASORT_RDATE == arg->navsort)
-			qsort(arg->sargs, arg->sposz, 
-				sizeof(struct article), rdatecmp);
-		else if (ASORT_FILENAME == arg->navsort)
-			qsort(arg->sargs, arg->sposz, 
-				sizeof(struct article), filenamecmp);
-		else if (ASORT_CMDLINE == arg->navsort)
-			qsort(arg->sargs, arg->sposz, 
-				sizeof(struct article), cmdlinecmp);
-	}
-
-	/*
-	 * Advance until "k" is at the article we want to start
-	 * printing.
-	 * This accounts for the starting article to show; which, due to
-	 * tagging, might not be a true offset.
-	 */
-	for (i = k = 0; i < arg->navstart && k < arg->sposz; k++) {
-		rc = tagfind(arg->navtags, arg->navtagsz, 
-			arg->sargs[k].tagmap, arg->sargs[k].tagmapsz);
-		i += 0 != rc;
-	}
-
-	/*
-	 * Start showing articles from the first one, above.
-	 * If we haven't been provided a navigation template (i.e., what
-	 * was within the navigation tags), then make a simple default
-	 * consisting of a list entry.
-	 */
-	for (i = j = 0; k < arg->sposz; k++) {
-		rc = tagfind(arg->navtags, arg->navtagsz, 
-			arg->sargs[k].tagmap, arg->sargs[k].tagmapsz);
-		/* Tag not found! */
-		if (0 == rc)
-			continue;
-		j++;
-		if (arg->navxml) {
-			xmltextx(arg->f, arg->nav, arg->dst,
-				arg->sargs, arg->sposz, k);
-		} else if ( ! arg->navuse || 0 == arg->navsz) {
-			(void)strftime(buf, sizeof(buf), "%F", 
-				localtime(&arg->sargs[k].time));
-			xmlopen(arg->f, "li", NULL);
-			fputs(buf, arg->f);
-			fputs(": ", arg->f);
-			xmlopen(arg->f, "a", "href", 
-				arg->sargs[k].src, NULL);
-			fputs(arg->sargs[k].titletext, arg->f);
-			xmlclose(arg->f, "a");
-			xmlclose(arg->f, "li");
-			fputc('\n', arg->f);
-		} else {
-			xmlopen(arg->f, "li", NULL);
-			xmltextx(arg->f, arg->nav, arg->dst, 
-				arg->sargs, arg->sposz, k);
-			xmlclose(arg->f, "li");
-		}
-		if (++i >= arg->navlen)
-			break;
-	}
-
-	if ( ! arg->navxml) {
-		xmlclose(arg->f, "ul");
-		xmlclose(arg->f, s);
-	}
-
-	xmlstrflush(arg->nav, &arg->navsz);
-
-	for (i = 0; i < arg->navtagsz; i++)
-		free(arg->navtags[i]);
-
-	free(arg->navtags);
-	arg->navtags = NULL;
-	arg->navtagsz = 0;
-
-	if (NULL != sv) {
-		free(arg->sargs);
-		arg->sargs = sv;
-	}
-}
-
-static void
-empty_end(void *dat, const XML_Char *s)
-{
-	struct linkall	*arg = dat;
-
-	if (0 == strcasecmp(s, "article") && 0 == --arg->stack) {
-		XML_SetElementHandler(arg->p, tmpl_begin, tmpl_end);
-		XML_SetDefaultHandlerExpand(arg->p, tmpl_text);
-	}
-}
-
-static void
-article_end(void *dat, const XML_Char *s)
-{
-	struct linkall	*arg = dat;
-
-	if (0 == strcasecmp(s, "article") && 0 == --arg->stack) {
-		XML_SetElementHandler(arg->p, tmpl_begin, tmpl_end);
-		XML_SetDefaultHandlerExpand(arg->p, tmpl_text);
-	}
-}
-
-static void
-tmpl_begin(void *dat, const XML_Char *s, const XML_Char **atts)
-{
-	struct linkall	 *arg = dat;
-	const XML_Char	**attp;
-	const XML_Char	 *sort = NULL;
-	char		**tags;
-	char		 *str, *tok, *tfr;
-	size_t		  i, tagsz;
-
-	assert(0 == arg->stack);
-
-	if (-1 != arg->single) {
-		xmltextx(arg->f, arg->buf, arg->dst, 
-			arg->sargs, arg->sposz, arg->single);
-		xmlstrflush(arg->buf, &arg->bufsz);
-	}
-
-	if (0 == strcasecmp(s, "nav")) {
-		/*
-		 * Only handle if containing the "data-sblg-nav"
-		 * attribute, otherwise continue.
-		 */
-		for (attp = atts; NULL != *attp; attp += 2) 
-			if (0 == strcasecmp(*attp, "data-sblg-nav"))
-				break;
-
-		if (NULL == *attp || ! xmlbool(attp[1])) {
-			xmlopens(arg->f, s, atts);
-			return;
-		}
-
-		/*
-		 * Take the number of elements to show to be the min of
-		 * the full count or as user-specified.
-		 */
-
-		arg->navuse = 0;
-		arg->navsort = ASORT_DATE;
-		arg->usesort = 0;
-		arg->navxml = 0;
-		arg->navlen = arg->sposz;
-		arg->navstart = 0;
-
-		for (attp = atts; NULL != *attp; attp += 2) {
-			if (0 == strcasecmp(attp[0], 
-					"data-sblg-navsz")) {
-				arg->navlen = atoi(attp[1]);
-				if (arg->navlen > (size_t)arg->sposz)
-					arg->navlen = arg->sposz;
-			} else if (0 == strcasecmp(attp[0],
-					"data-sblg-navstart")) {
-				arg->navstart = atoi(attp[1]);
-				if (arg->navstart > (size_t)arg->sposz)
-					arg->navstart = arg->sposz;
-				if (arg->navstart)
-					arg->navstart--;
-			} else if (0 == strcasecmp(attp[0], 
-					"data-sblg-navcontent")) {
-				arg->navuse = xmlbool(attp[1]);
-			} else if (0 == strcasecmp(attp[0],
-					"data-sblg-navxml")) {
-				arg->navxml = xmlbool(attp[1]);
-			} else if (0 == strcasecmp(attp[0], 
-					"data-sblg-navtag")) {
-				hashtag(&arg->navtags, 
-					&arg->navtagsz, attp[1]);
-			} else if (0 == strcasecmp(attp[0],
-					"data-sblg-navsort")) {
-				sort = attp[1];
-			}
-		}
-
-		/* Are we overriding the sort order? */
-
-		if (NULL != sort) {
-			arg->usesort = 1;
-			if (0 == strcasecmp(sort, "date"))
-				arg->navsort = ASORT_DATE;
-			else if (0 == strcasecmp(sort, "rdate"))
-				arg->navsort = ASORT_RDATE;
-			else if (0 == strcasecmp(sort, "filename"))
-				arg->navsort = ASORT_FILENAME;
-			else if (0 == strcasecmp(sort, "cmdline"))
-				arg->navsort = ASORT_CMDLINE;
-			else
-				arg->usesort = 0;
-		}
-
-		if ( ! arg->navxml)
-			xmlopens(arg->f, s, atts);
-
-		arg->stack++;
-		XML_SetElementHandler(arg->p, nav_begin, nav_end);
-		XML_SetDefaultHandlerExpand(arg->p, nav_text);
-		return;
-	} else if (strcasecmp(s, "article")) {
-		if (-1 != arg->single)
-			xmlopensx(arg->f, s, atts, arg->dst, 
-				arg->sargs, arg->sposz, arg->single);
-		else
-			xmlopens(arg->f, s, atts);
-		return;
-	}
-
-	/*
-	 * Only consider article elements if they contain the magic
-	 * data-sblg-article attribute.
-	 */
-	for (attp = atts; NULL != *attp; attp += 2) 
-		if (0 == strcasecmp(*attp, "data-sblg-article"))
-			break;
-
-	if (NULL == *attp || ! xmlbool(attp[1])) {
-		xmlopens(arg->f, s, atts);
-		return;
-	}
-
-	/*
-	 * See if we should only output certain tags.
-	 * To accomplish this, we first parse the requested tags in
-	 * "articletag" into an array of tags.
-	 * This attribute may happen multiple times.
-	 */
-	tags = NULL;
-	tagsz = 0;
-	for (attp = atts; NULL != *attp; attp += 2) {
-		if (strcasecmp(*attp, "data-sblg-articletag")) 
-			continue;
-		tfr = str = xstrdup(attp[1]);
-		while (NULL != (tok = strsep(&str, " \t"))) {
-			tags = xreallocarray(tags,
-				tagsz + 1, sizeof(char *));
-			tags[tagsz++] = xstrdup(tok);
-		}
-		free(tfr);
-	}
-
-	/* Look for the next article mathing the given tag. */
-	for ( ; arg->spos < arg->ssposz; arg->spos++)
-		if (tagfind(tags, tagsz, 
-		    arg->sargs[arg->spos].tagmap,
-		    arg->sargs[arg->spos].tagmapsz))
-			break;
-
-	for (i = 0; i < tagsz; i++)
-		free(tags[i]);
-	free(tags);
-
-	if (arg->spos >= arg->ssposz) {
-		/*
-		 * We have no articles left to show.
-		 * Just continue throwing away this article element til
-		 * we receive a matching one.
-		 */
-		arg->stack++;
-		XML_SetDefaultHandlerExpand(arg->p, NULL);
-		XML_SetElementHandler(arg->p, article_begin, empty_end);
-		return;
-	}
-
-	/*
-	 * First throw away children, then push out the article itself.
-	 */
-	arg->stack++;
-	XML_SetDefaultHandlerExpand(arg->p, NULL);
-	XML_SetElementHandler(arg->p, article_begin, article_end);
-
-	/* Echo the formatted text of the article. */
-	xmltextx(arg->f, arg->sargs[arg->spos].article, 
-		arg->dst, arg->sargs, arg->sposz, arg->spos);
-	arg->spos++;
-
-	for (attp = atts; NULL != *attp; attp += 2) 
-		if (0 == strcasecmp(*attp, "data-sblg-permlink"))
-			break;
-	if (NULL != *attp && ! xmlbool(attp[1]))
-		return;
-
-	xmlopen(arg->f, "div", "data-sblg-permlink", "1", NULL);
-	xmlopen(arg->f, "a", "href", arg->sargs[arg->spos - 1].src, NULL);
-	fputs("permanent link", arg->f);
-	xmlclose(arg->f, "a");
-	xmlclose(arg->f, "div");
-	fputc('\n', arg->f);
-}
-
 /*
  * Given a set of articles "src", grok articles from the files, then
  * fill in a template that's usually the blog "front page".
  */
 int
-linkall(XML_Parser p, const char *templ, const char *force, 
-	int sz, char *src[], const char *dst, enum asort asort)
+linkall(XML_Parser p, const struct popts *po, const char *templ, 
+	const char *force, int sz, char *src[], 
+	const char *dst, enum asort asort)
 {
-	char		*buf;
-	size_t		 j, ssz;
-	int		 i, fd, rc;
-	FILE		*f;
-	struct linkall	 larg;
+	size_t		 j, first, last, slots;
+	int		 rc;
+	struct out	*f;
+	struct tmpl	*t;
 	struct article	*sargs;
 	size_t		 sargsz;
+	const size_t	*perm;
+	struct artset	 set;
+	struct popts	 mpo;
 
-	ssz = 0;
 	rc = 0;
-	buf = NULL;
-	fd = -1;
 	f = NULL;
-
-	memset(&larg, 0, sizeof(struct linkall));
+	t = NULL;
 	sargs = NULL;
 	sargsz = 0;
+	artset_init(&set, NULL, 0);
 
-	/* Grok all article data and sort by date. */
-	for (i = 0; i < sz; i++)
-		if ( ! sblg_parse(p, src[i], &sargs, &sargsz))
-			goto out;
+	/* 
+	 * Compile the template.
+	 * This tells us whether we need article bodies at all.
+	 * If we only show a few, have them parsed on demand, unless we
+	 * have a cache that would rather have them in full.
+	 */
+	t = tmpl_compile(p, templ, NULL == force ?
+		TMPL_LINKALL : TMPL_LINKALL_SINGLE);
+	if (NULL == t)
+		goto out;
+
+	mpo = *po;
+	if (0 == (slots = tmpl_slots(t)))
+		mpo.body = PBODY_NONE;
+	else if (NULL == po->cache &&
+		 (NULL != force || slots < (size_t)sz))
+		mpo.body = PBODY_LAZY;
 
-	if (ASORT_DATE == asort)
-		qsort(sargs, sargsz, sizeof(struct article), datecmp);
-	else if (ASORT_RDATE == asort)
-		qsort(sargs, sargsz, sizeof(struct article), rdatecmp);
-	else if (ASORT_FILENAME == asort)
-		qsort(sargs, sargsz, sizeof(struct article), filenamecmp);
-
-	/* Open a FILE to the output file or stream. */
-	f = stdout;
-	if (strcmp(dst, "-") && (NULL == (f = fopen(dst, "w")))) {
-		warn("%s", dst);
+	/* Grok all article data and sort by date. */
+	if ( ! sblg_parse_all(p, &mpo, sz, src, &sargs, &sargsz))
 		goto out;
-	} 
-	
-	/* Map the template into memory for parsing. */
-	if ( ! mmap_open(templ, &fd, &buf, &ssz))
+
+	artset_init(&set, sargs, sargsz);
+	perm = artset_order(&set, asort);
+
+	/* Open the output file or stream. */
+	if (NULL == (f = out_open(dst)))
 		goto out;
 
 	/*
@@ -508,22 +92,16 @@ linkall(XML_Parser p, const char *templ, const char *force,
 	 * input; however, if we're going to force a single entry to be
 	 * shown, then find it in our arguments.
 	 */
-	larg.sargs = sargs;
-	larg.sposz = larg.ssposz = sargsz;
-	larg.p = p;
-	larg.src = templ;
-	larg.dst = strcmp(dst, "-") ? dst : NULL;
-	larg.f = f;
-	larg.single = -1;
+	first = 0;
+	last = sargsz;
 
 	if (NULL != force) {
 		for (j = 0; j < sargsz; j++)
-			if (0 == strcmp(force, sargs[j].src))
+			if (0 == strcmp(force, sargs[perm[j]].src))
 				break;
 		if (j < sargsz) {
-			larg.single = j;
-			larg.spos = j;
-			larg.ssposz = j + 1;
+			first = j;
+			last = j + 1;
 		} else {
 			warnx("%s: does not "
 				"appear in input list", force);
@@ -531,150 +109,281 @@ linkall(XML_Parser p, const char *templ, const char *force,
 		}
 	}
 
-	/* Run the XML parser on the template. */
-	XML_ParserReset(p, NULL);
-	XML_SetDefaultHandlerExpand(p, tmpl_text);
-	XML_SetElementHandler(p, tmpl_begin, tmpl_end);
-	XML_SetUserData(p, &larg);
-
-	if (XML_STATUS_OK != XML_Parse(p, buf, (int)ssz, 1)) {
-		warnx("%s:%zu:%zu: %s", templ, 
-			XML_GetCurrentLineNumber(p),
-			XML_GetCurrentColumnNumber(p),
-			XML_ErrorString(XML_GetErrorCode(p)));
-		goto out;
-	} 
-
-	fputc('\n', f);
+	tmpl_exec(t, f, strcmp(dst, "-") ? dst : NULL,
+		&set, asort, first, last, 0, NULL);
+	out_putc(f, '\n');
 	rc = 1;
 out:
+	artset_free(&set);
 	sblg_free(sargs, sargsz);
-	mmap_close(fd, buf, ssz);
-	if (NULL != f && stdout != f)
-		fclose(f);
-
-	for (j = 0; j < larg.navtagsz; j++)
-		free(larg.navtags[j]);
-	free(larg.navtags);
-	free(larg.nav);
-	free(larg.buf);
+	tmpl_free(t);
+	if ( ! out_close(f))
+		rc = 0;
 	return(rc);
 }
 
+/*
+ * Name the output of each article of "set" at its position in order
+ * "asort" by its input file (see outname()).
+ * A file with several articles has an output for each, all with the
+ * same name: only the last would remain, so the others are NULL.
+ * Returns an array of the set's size.
+ */
+char **
+linkall_dsts(struct artset *set, enum asort asort)
+{
+	char		**dsts;
+	size_t		 j, *ids, *last;
+	const size_t	*perm;
+	struct strmap	*map;
+
+	perm = artset_order(set, asort);
+	dsts = xcalloc(set->artsz, sizeof(char *));
+	ids = xcalloc(set->artsz, sizeof(size_t));
+	last = xcalloc(set->artsz, sizeof(size_t));
+	map = strmap_alloc();
+
+	for (j = 0; j < set->artsz; j++) {
+		dsts[j] = outname(set->arts[perm[j]].src);
+		ids[j] = strmap_put(map, dsts[j]);
+		last[ids[j]] = j;
+	}
+
+	/* Free the map first: its keys are the names. */
+
+	strmap_free(map);
+	for (j = 0; j < set->artsz; j++)
+		if (last[ids[j]] != j) {
+			free(dsts[j]);
+			dsts[j] = NULL;
+		}
+
+	free(ids);
+	free(last);
+	return(dsts);
+}
+
+/*
+ * Render the page at position "j" of "set" in order "asort" with the
+ * template "t" into memory (see out_mem()) for the output "dsts[j]"
+ * (see linkall_dsts()), within "dir" if not NULL.
+ * Returns the output for the caller to close or NULL on failure.
+ */
+struct out *
+linkall_page(const struct tmpl *t, struct artset *set, 
+	enum asort asort, char **dsts, size_t j, const char *dir)
+{
+	struct out	*f = NULL;
+	char		*path;
+
+	path = NULL == dir ? dsts[j] : outpath(dir, dsts[j]);
+	if (NULL == dir || mkparents(path)) {
+		f = out_mem(path);
+		tmpl_exec(t, f, dsts[j], set, 
+			asort, j, j + 1, j > 0, NULL);
+		out_putc(f, '\n');
+	}
+	if (path != dsts[j])
+		free(path);
+	return(f);
+}
+
+/*
+ * Pages being rendered by linkall_r(), shared by its workers.
+ */
+struct	rjob {
+	const struct tmpl *t; /* compiled template */
+	struct artset	*set; /* articles (shared) */
+	enum asort	 asort; /* order of pages */
+	char		**dsts; /* output per position or NULL to skip */
+	const char	*dir; /* output directory or NULL */
+	size_t		 sz; /* number of positions */
+	size_t		 next; /* next position to take */
+	int		 failed; /* whether any page failed */
+	pthread_mutex_t	 mutex; /* guards next and failed */
+	struct writer	*writer; /* outputs or NULL to write here */
+	struct stage	*rst; /* renderer statistics or NULL */
+	struct stage	*wst; /* writer statistics or NULL */
+};
+
+/*
+ * Take pages one at a time until none are left.
+ * Taking them one by one balances large and small pages across
+ * workers; each page's errors are reported on their own.
+ * Pages are rendered into memory, then passed to the writer (or, if
+ * there is none, written here).
+ */
+static void *
+render_worker(void *dat)
+{
+	struct rjob	*job = dat;
+	struct out	*f;
+	size_t		 j, items = 0;
+	int		 rc;
+	double		 start, t, wait = 0.0, wbusy = 0.0;
+
+	start = stage_time();
+	for (;;) {
+		pthread_mutex_lock(&job->mutex);
+		while (job->next < job->sz && 
+		       NULL == job->dsts[job->next])
+			job->next++;
+		j = job->next++;
+		pthread_mutex_unlock(&job->mutex);
+
+		if (j >= job->sz)
+			break;
+
+		items++;
+		f = linkall_page(job->t, job->set, 
+			job->asort, job->dsts, j, job->dir);
+
+		if (NULL != f && NULL != job->writer) {
+			writer_put(job->writer, f, &wait);
+			continue;
+		} else if (NULL != f) {
+			t = stage_time();
+			rc = out_close(f);
+			wbusy += stage_time() - t;
+			if (rc)
+				continue;
+		}
+
+		pthread_mutex_lock(&job->mutex);
+		job->failed = 1;
+		pthread_mutex_unlock(&job->mutex);
+	}
+
+	if (NULL != job->writer)
+		writer_done(job->writer);
+	else
+		stage_add(job->wst, items, wbusy, 0.0);
+	stage_add(job->rst, items, 
+		stage_time() - start - wait - wbusy, wait);
+	return(NULL);
+}
+
 /*
  * Like linkall() but does the output in place: groks all input files,
  * then converts them to output.
  * This prevents needing to run -C with each input file.
+ * Outputs are written within "dir", if not NULL (see outpath()).
+ * Pages are rendered by up to "jobs" threads (see struct popts), and
+ * with more than one, written by another as they're rendered.
  */
 int
-linkall_r(XML_Parser p, const char *templ, 
-	int sz, char *src[], enum asort asort)
+linkall_r(XML_Parser p, const struct popts *po, const char *templ, 
+	int sz, char *src[], const char *dir, enum asort asort)
 {
-	char		*buf = NULL, *dst = NULL;
-	size_t		 j, ssz = 0, wsz;
-	int		 i, fd = -1, rc = 0;
-	FILE		*f = NULL;
-	struct linkall	 larg;
+	char		**dsts = NULL;
+	size_t		 i, j, nthreads;
+	int		 er, rc = 0;
+	struct tmpl	*t = NULL;
 	struct article	*sargs = NULL;
 	size_t		 sargsz = 0;
-	const char	*cp;
+	struct artset	 set;
+	struct popts	 mpo;
+	struct rjob	 job;
+	struct stage	*pst = NULL, *rst = NULL, *wst = NULL;
+	pthread_t	*threads;
+	double		 start, wall;
 
-	memset(&larg, 0, sizeof(struct linkall));
+	artset_init(&set, NULL, 0);
 
 	/* 
-	 * Grok all article data then sort.
-	 * Ignore cmdline sort order: it's already like that.
+	 * Compile the template once for all outputs.
+	 * This tells us whether we need article bodies at all.
 	 */
 
-	for (i = 0; i < sz; i++)
-		if ( ! sblg_parse(p, src[i], &sargs, &sargsz))
-			goto out;
+	if (NULL == (t = tmpl_compile(p, templ, TMPL_LINKALL_SINGLE)))
+		goto out;
 
-	if (ASORT_DATE == asort)
-		qsort(sargs, sargsz, 
-			sizeof(struct article), datecmp);
-	else if (ASORT_RDATE == asort)
-		qsort(sargs, sargsz, 
-			sizeof(struct article), rdatecmp);
-	else if (ASORT_FILENAME == asort)
-		qsort(sargs, sargsz, 
-			sizeof(struct article), filenamecmp);
+	mpo = *po;
+	if (0 == tmpl_slots(t))
+		mpo.body = PBODY_NONE;
 
-	/* Map the template into memory for parsing. */
+	/* 
+	 * Grok all article data then sort.
+	 * Ignore cmdline sort order: it's already like that.
+	 * Every page may refer to every article (navigation, tags), so
+	 * this must finish before any rendering.
+	 */
 
-	if ( ! mmap_open(templ, &fd, &buf, &ssz))
+	if (po->stats) {
+		pst = stage_alloc("parse");
+		rst = stage_alloc("render");
+		wst = stage_alloc("write");
+	}
+
+	start = stage_time();
+	if ( ! sblg_parse_all(p, &mpo, sz, src, &sargs, &sargsz))
 		goto out;
+	stage_add(pst, (size_t)sz, stage_time() - start, 0.0);
 
-	/*
-	 * Iterate through each input article.
-	 * Replace its filename with HTML and use that as the output.
+	artset_init(&set, sargs, sargsz);
+	dsts = linkall_dsts(&set, asort);
+
+	/* 
+	 * Render, sharing the articles between workers, and write from
+	 * another thread, bounding pending pages to a few per worker.
+	 * With only one, render and write here.
 	 */
 
-	for (j = 0; j < sargsz; j++) {
-		wsz = strlen(sargs[j].src);
-		if (NULL == (cp = strrchr(sargs[j].src, '.')) ||
-				strcasecmp(cp + 1, "xml")) {
-			/* Append .html to input name. */
-			dst = xmalloc(wsz + 6);
-			strlcpy(dst, sargs[j].src, wsz + 6);
-			strlcat(dst, ".html", wsz + 6);
-		} else {
-			/* Replace .xml with .html. */
-			dst = xmalloc(wsz + 2);
-			strlcpy(dst, sargs[j].src, wsz - 2);
-			strlcat(dst, "html", wsz + 2);
-		} 
-
-		/* Open the output filename. */
-		
-		if (NULL == (f = fopen(dst, "w"))) {
-			warn("%s", dst);
-			goto out;
-		} 
-
-		larg.sargs = sargs;
-		larg.sposz = sargsz;
-		larg.p = p;
-		larg.src = templ;
-		larg.dst = dst;
-		larg.f = f;
-		larg.single = j;
-		larg.spos = j;
-		larg.ssposz = j + 1;
-
-		/* Run the XML parser on the template. */
-
-		XML_ParserReset(p, NULL);
-		XML_SetDefaultHandlerExpand(p, tmpl_text);
-		XML_SetElementHandler(p, tmpl_begin, tmpl_end);
-		XML_SetUserData(p, &larg);
-
-		if (XML_STATUS_OK != XML_Parse(p, buf, (int)ssz, 1)) {
-			warnx("%s:%zu:%zu: %s", templ, 
-				XML_GetCurrentLineNumber(p),
-				XML_GetCurrentColumnNumber(p),
-				XML_ErrorString(XML_GetErrorCode(p)));
-			goto out;
-		} 
+	memset(&job, 0, sizeof(struct rjob));
+	job.t = t;
+	job.set = &set;
+	job.asort = asort;
+	job.dsts = dsts;
+	job.dir = dir;
+	job.sz = sargsz;
+	job.rst = rst;
+	job.wst = wst;
+	if (0 != (er = pthread_mutex_init(&job.mutex, NULL))) {
+		errno = er;
+		err(EXIT_FAILURE, "pthread_mutex_init");
+	}
 
-		fputc('\n', f);
-		fclose(f);
-		f = NULL;
-		free(dst);
-		dst = NULL;
+	nthreads = po->jobs < sargsz ? po->jobs : sargsz;
+
+	if (nthreads <= 1)
+		render_worker(&job);
+	else {
+		tmpl_prepare(t, &set, asort);
+		artset_share(&set);
+		job.writer = writer_alloc(2 * nthreads, nthreads, wst);
+		threads = xcalloc(nthreads, sizeof(pthread_t));
+		for (i = 0; i < nthreads; i++) {
+			er = pthread_create(&threads[i], 
+				NULL, render_worker, &job);
+			if (0 != er) {
+				errno = er;
+				err(EXIT_FAILURE, "pthread_create");
+			}
+		}
+		for (i = 0; i < nthreads; i++)
+			pthread_join(threads[i], NULL);
+		free(threads);
+		if ( ! writer_free(job.writer))
+			job.failed = 1;
 	}
-	rc = 1;
 
+	pthread_mutex_destroy(&job.mutex);
+	rc = ! job.failed;
+
+	wall = stage_time() - start;
+	stage_print(pst, wall);
+	stage_print(rst, wall);
+	stage_print(wst, wall);
 out:
+	stage_free(pst);
+	stage_free(rst);
+	stage_free(wst);
+	if (NULL != dsts)
+		for (j = 0; j < sargsz; j++)
+			free(dsts[j]);
+	free(dsts);
+	artset_free(&set);
 	sblg_free(sargs, sargsz);
-	mmap_close(fd, buf, ssz);
-	if (NULL != f)
-		fclose(f);
-	for (j = 0; j < larg.navtagsz; j++)
-		free(larg.navtags[j]);
-	free(larg.navtags);
-	free(larg.nav);
-	free(larg.buf);
-	free(dst);
+	tmpl_free(t);
 	return(rc);
 }
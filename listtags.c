@@ -16,220 +16,170 @@
  */
 #include "config.h"
 
-#include <sys/queue.h>
-
 #include <assert.h>
 #include <ctype.h>
 #if HAVE_ERR
 # include <err.h>
 #endif
 #include <expat.h>
-#include <search.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "extern.h"
 
-struct	filen {
-	const char	  *fn;
-	TAILQ_ENTRY(filen) entries;
-};
-
-TAILQ_HEAD(filenq, filen);
-
-struct	tagn {
-	struct filenq	 *fq;
-	char	 	 *tag;
-	TAILQ_ENTRY(tagn) entries;
-};
-
-TAILQ_HEAD(tagnq, tagn);
-
 /*
  * Strip escaped white-space.
  * XXX: should we do any escaping here?
  */
 static void
-unescape(const char *cp)
+unescape(struct out *f, const char *cp)
 {
  
 	for ( ; '\0' != *cp; cp++)
 		if ( ! ('\\' == cp[0] && ' ' == cp[1]))
-			putchar(*cp);
+			out_putc(f, *cp);
 }
 
 /*
  * Print tags in tag-major ordering.
  * This will print the articles referencing individual tags.
- * This is more complicated because our data comes in article-major
- * ordering so we need to hash entries and bucket.
+ * Our data comes in article-major ordering, so this uses the tags as
+ * indexed by the article set: each tag's articles are kept in order.
  */
-static int
-dorlist(const struct article *sargs, size_t sargsz, int json)
+static void
+dorlist(struct out *f, struct artset *set, int json)
 {
-	size_t	 	 i, j;
-	char		*copy;
-	ENTRY		 e;
-	ENTRY		*ep;
-	struct filenq	*fq;
-	struct filen	*fn;
-	struct tagnq	 tq;
-	struct tagn	*tn;
-
-	/*
-	 * Start by creating a table of all tags and the files that
-	 * reference those tags.
-	 * Use the shitty hcreate() interface.
-	 */
-
-	if ( ! hcreate(256)) {
-		warnx("hcreate");
-		return(0);
-	}
+	size_t	 	 i, j, tagsz, postsz;
+	const size_t	*post;
+	const char	*tag;
 
-	TAILQ_INIT(&tq);
-
-	for (i = 0; i < sargsz; i++) {
-		for (j = 0; j < sargs[i].tagmapsz; j++) {
-			e.key = sargs[i].tagmap[j];
-			e.data = NULL;
-			if (NULL == (ep = hsearch(e, FIND))) {
-				fq = xmalloc(sizeof(struct filenq));
-				TAILQ_INIT(fq);
-				e.data = fq;
-				copy = xstrdup(sargs[i].tagmap[j]);
-				e.key = copy;
-				if (NULL == (ep = hsearch(e, ENTER))) {
-					warnx("hsearch");
-					return(0);
-				}
-				tn = xmalloc(sizeof(struct tagn));
-				tn->tag = copy;
-				tn->fq = fq;
-				TAILQ_INSERT_TAIL(&tq, tn, entries);
-			}
-			fq = ep->data;
-			fn = xmalloc(sizeof(struct filen));
-			fn->fn = sargs[i].src;
-			TAILQ_INSERT_TAIL(fq, fn, entries);
-		}
-	}
+	tagsz = artset_tagsz(set);
 
-	TAILQ_FOREACH(tn, &tq, entries) {
+	for (i = 0; i < tagsz; i++) {
+		tag = artset_tagname(set, i);
+		post = artset_tagged(set, i, &postsz);
 		if (json) {
-			printf("{\"tag\": \"");
-			unescape(tn->tag);
-			printf("\", \n \"srcs\": [");
+			out_puts(f, "{\"tag\": \"");
+			unescape(f, tag);
+			out_puts(f, "\", \n \"srcs\": [");
 		}
-		TAILQ_FOREACH(fn, tn->fq, entries) {
+		for (j = 0; j < postsz; j++) {
 			if (json)
-				putchar('"');
-			else
-				printf("%s\t", tn->tag);
-			printf("%s", fn->fn);
+				out_putc(f, '"');
+			else {
+				out_puts(f, tag);
+				out_putc(f, '\t');
+			}
+			out_puts(f, set->arts[post[j]].src);
 			if (json)
-				putchar('"');
+				out_putc(f, '"');
 			else
-				putchar('\n');
-			if (json && TAILQ_NEXT(fn, entries))
-				putchar(',');
+				out_putc(f, '\n');
+			if (json && j < postsz - 1)
+				out_putc(f, ',');
 		}
-		if (json && TAILQ_NEXT(tn, entries))
-			puts("]},");
+		if (json && i < tagsz - 1)
+			out_puts(f, "]},\n");
 		else if (json)
-			puts("]}");
-	}
-
-	/*
-	 * Clean up the hashtable entries.
-	 * XXX: on Linux, the "key" value to the ENTER-created table
-	 * entries is not destroyed, so we do that later.
-	 */
-
-	hdestroy();
-
-	while (NULL != (tn = TAILQ_FIRST(&tq))) {
-		while (NULL != (fn = TAILQ_FIRST(tn->fq))) {
-			TAILQ_REMOVE(tn->fq, fn, entries);
-			free(fn);
-		}
-		TAILQ_REMOVE(&tq, tn, entries);
-#ifdef __linux__
-		free(tn->tag);
-#endif
-		free(tn->fq);
-		free(tn);
+			out_puts(f, "]}\n");
 	}
-
-	return(1);
 }
 
 /*
  * Print article-major ordering.
  * This prints the tags belonging to each article.
  */
-static int
-dolist(const struct article *sargs, size_t sargsz, int json)
+static void
+dolist(struct out *f, const struct artset *set, int json)
 {
+	const struct article *art;
 	size_t	 	 i, j;
 
-	for (i = 0; i < sargsz; i++) {
-		if (json)
-			printf("{\"src\": \"%s\", \n"
-			       " \"tags\": [", sargs[i].src);
-		for (j = 0; j < sargs[i].tagmapsz; j++) {
+	for (i = 0; i < set->artsz; i++) {
+		art = &set->arts[i];
+		if (json) {
+			out_puts(f, "{\"src\": \"");
+			out_puts(f, art->src);
+			out_puts(f, "\", \n \"tags\": [");
+		}
+		for (j = 0; j < art->tagmapsz; j++) {
 			if (json && j > 0)
-				putchar(',');
+				out_putc(f, ',');
 			if (json)
-				putchar('"');
-			else
-				printf("%s\t", sargs[i].src);
-			unescape(sargs[i].tagmap[j]);
+				out_putc(f, '"');
+			else {
+				out_puts(f, art->src);
+				out_putc(f, '\t');
+			}
+			unescape(f, art->tagmap[j]);
 			if (json)
-				putchar('"');
+				out_putc(f, '"');
 			else
-				putchar('\n');
+				out_putc(f, '\n');
 		}
-		if (json && i < sargsz - 1)
-			puts("]},");
+		if (json && i < set->artsz - 1)
+			out_puts(f, "]},\n");
 		else if (json)
-			puts("]}");
+			out_puts(f, "]}\n");
 	}
+}
+
+/*
+ * Emit the tag listing of the articles in "set" to "f", tag-major if
+ * "reverse", as JSON if "json".
+ * This only computes the set's tag index if it isn't already.
+ */
+void
+listtags_exec(struct out *f, struct artset *set, int json, int reverse)
+{
+
+	if (json)
+		out_puts(f, "{[\n");
+
+	if (reverse)
+		dorlist(f, set, json);
+	else
+		dolist(f, set, json);
 
-	return(1);
+	if (json)
+		out_puts(f, "]}\n");
 }
 
 int
-listtags(XML_Parser p, int sz, char *src[], int json, int reverse)
+listtags(XML_Parser p, const struct popts *po, 
+	int sz, char *src[], int json, int reverse)
 {
 	size_t		 sargsz = 0;
-	int		 i, rc;
+	int		 rc = 0;
 	struct article	*sargs = NULL;
+	struct artset	 set;
+	struct popts	 mpo;
+	struct out	*f;
 
-	/* First run the initial parse of all files. */
-
-	for (i = 0; i < sz; i++) 
-		if ( ! sblg_parse(p, src[i], &sargs, &sargsz)) {
-			sblg_free(sargs, sargsz);
-			return(0);
-		}
+	/* 
+	 * First run the initial parse of all files.
+	 * We only need their tags, not the bodies.
+	 */
 
-	/* Now actually emit the listings. */
+	mpo = *po;
+	mpo.body = PBODY_NONE;
 
-	if (json)
-		puts("{[");
+	artset_init(&set, NULL, 0);
 
-	rc = reverse ?
-		dorlist(sargs, sargsz, json) :
-		dolist(sargs, sargsz, json);
+	if ( ! sblg_parse_all(p, &mpo, sz, src, &sargs, &sargsz))
+		goto out;
 
-	if (json)
-		puts("]}");
-
-	/* Cleanup and exit. */
+	/* Now actually emit the listings. */
 
+	artset_init(&set, sargs, sargsz);
+	if (NULL != (f = out_open("-"))) {
+		listtags_exec(f, &set, json, reverse);
+		rc = out_close(f);
+	}
+out:
+	artset_free(&set);
 	sblg_free(sargs, sargsz);
 	return(rc);
 }
-
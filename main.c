@@ -40,7 +40,9 @@ enum	op {
 	OP_COMPILE,
 	OP_BLOG,
 	OP_LISTTAGS,
-	OP_LINK_INPLACE
+	OP_LINK_INPLACE,
+	OP_BUILD,
+	OP_INDEX
 };
 
 #if HAVE_SANDBOX_INIT
@@ -74,11 +76,17 @@ sandbox_openbsd(void)
 int
 main(int argc, char *argv[])
 {
-	int		 ch, i, rc, fmtjson = 0, rev = 0;
-	const char	*progname, *templ, *outfile, *force;
+	int		 ch, rc, fmtjson = 0, rev = 0;
+	const char	*progname, *templ, *outfile, *outdir, *force, *er;
+	const char	**dirs = NULL, **pats = NULL;
+	size_t		 j, dirsz = 0, patsz = 0, tgsz = 0;
 	enum op		 op;
 	enum asort	 asort;
 	XML_Parser	 p;
+	struct popts	 po;
+	struct srclist	 srcs;
+	struct tmpl	*t;
+	struct target	*tgs = NULL, idx;
 
 	setlocale(LC_ALL, "");
 
@@ -93,11 +101,14 @@ main(int argc, char *argv[])
 	else
 		++progname;
 
-	templ = outfile = force = NULL;
+	templ = outfile = outdir = force = NULL;
 	op = OP_BLOG;
 	asort = ASORT_DATE;
+	memset(&po, 0, sizeof(struct popts));
+	memset(&srcs, 0, sizeof(struct srclist));
+	po.jobs = 1;
 
-	while (-1 != (ch = getopt(argc, argv, "acjlLrC:o:s:t:")))
+	while (-1 != (ch = getopt(argc, argv, "acjlLPrvC:d:f:J:K:o:p:R:s:t:T:")))
 		switch (ch) {
 		case ('a'):
 			op = OP_ATOM;
@@ -108,21 +119,53 @@ main(int argc, char *argv[])
 		case ('C'):
 			force = optarg;
 			break;
+		case ('d'):
+			outdir = optarg;
+			break;
+		case ('f'):
+			if ( ! srclist_file(&srcs, optarg)) {
+				srclist_free(&srcs);
+				return(EXIT_FAILURE);
+			}
+			break;
 		case ('j'):
 			fmtjson = 1;
 			break;
+		case ('J'):
+			po.jobs = strtonum(optarg, 1, 1024, &er);
+			if (NULL != er) {
+				warnx("-J: %s: %s", optarg, er);
+				goto usage;
+			}
+			break;
 		case ('l'):
 			op = OP_LISTTAGS;
 			break;
+		case ('K'):
+			po.cache = optarg;
+			break;
 		case ('L'):
 			op = OP_LINK_INPLACE;
 			break;
 		case ('o'):
 			outfile = optarg;
 			break;
+		case ('P'):
+			op = OP_INDEX;
+			break;
+		case ('p'):
+			pats = xreallocarray(pats, 
+				patsz + 1, sizeof(char *));
+			pats[patsz++] = optarg;
+			break;
 		case ('r'):
 			rev = 1;
 			break;
+		case ('R'):
+			dirs = xreallocarray(dirs, 
+				dirsz + 1, sizeof(char *));
+			dirs[dirsz++] = optarg;
+			break;
 		case ('s'):
 			if (0 == strcasecmp(optarg, "date"))
 				asort = ASORT_DATE;
@@ -138,6 +181,17 @@ main(int argc, char *argv[])
 		case ('t'):
 			templ = optarg;
 			break;
+		case ('T'):
+			op = OP_BUILD;
+			tgs = xreallocarray(tgs, 
+				tgsz + 1, sizeof(struct target));
+			if ( ! target_parse(&tgs[tgsz], optarg))
+				goto usage;
+			tgsz++;
+			break;
+		case ('v'):
+			po.stats = 1;
+			break;
 		default:
 			goto usage;
 		}
@@ -145,11 +199,40 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
+	/*
+	 * Names from list files come first, then from directory walks,
+	 * then operands.
+	 * From here on, "argc" and "argv" are the full list.
+	 */
+
+	if (0 == patsz) {
+		pats = xreallocarray(pats, 1, sizeof(char *));
+		pats[patsz++] = "*.xml";
+	}
+
+	for (j = 0; j < dirsz; j++)
+		if ( ! srclist_dir(&srcs, dirs[j], pats, patsz, po.jobs)) {
+			free(dirs);
+			free(pats);
+			srclist_free(&srcs);
+			return(EXIT_FAILURE);
+		}
+
+	free(dirs);
+	free(pats);
+	dirs = pats = NULL;
+
+	srclist_argv(&srcs, argc, argv);
+	argc = (int)srcs.sz;
+	argv = srcs.v;
+
 	if (0 == argc)
 		goto usage;
 
 	if (OP_BLOG == op && fmtjson)
 		op = OP_ATOM;
+	else if (tgsz > 0 && OP_BUILD != op)
+		goto usage;
 
 	/*
 	 * Avoid constantly re-using a parser by specifying one here.
@@ -162,25 +245,27 @@ main(int argc, char *argv[])
 	switch (op) {
 	case (OP_COMPILE):
 		/*
-		 * Merge a single input XML file into a template XML
-		 * files to produce output.
-		 * (This can happen multiple times if we're spitting
-		 * into stdout.)
+		 * Merge each input XML file into a template XML
+		 * file to produce output.
+		 * The template is compiled once for all of them.
 		 */
 		if (NULL == templ)
 			templ = "article-template.xml";
-		if (1 == argc) {
-			rc = compile(p, templ, argv[0], outfile);
+		if (NULL == (t = tmpl_compile(p, templ, TMPL_COMPILE))) {
+			rc = 0;
 			break;
 		}
-		for (i = 0, rc = 1; rc && i < argc; i++)
-			rc = compile(p, templ, argv[i], NULL);
+		if (1 == argc)
+			rc = compile(p, t, argv[0], outfile, outdir);
+		else
+			rc = compile_all(&po, t, argc, argv, outdir);
+		tmpl_free(t);
 		break;
 	case (OP_ATOM):
 		if (fmtjson) {
 			if (NULL == outfile)
 				outfile = "blog.json";
-			rc = json(p, argc, argv, outfile, asort);
+			rc = json(p, &po, argc, argv, outfile, asort);
 			break;
 		}
 		/*
@@ -191,14 +276,32 @@ main(int argc, char *argv[])
 			templ = "atom-template.xml";
 		if (NULL == outfile)
 			outfile = "atom.xml";
-		rc = atom(p, templ, argc, 
+		rc = atom(p, &po, templ, argc, 
 			argv, outfile, asort);
 		break;
 	case (OP_LISTTAGS):
 		/*
 		 * List all tags and the filename(s) they're found in.
 		 */
-		rc = listtags(p, argc, argv, fmtjson, rev);
+		rc = listtags(p, &po, argc, argv, fmtjson, rev);
+		break;
+	case (OP_BUILD):
+		/*
+		 * Produce all of the given targets from one parse of
+		 * the input files.
+		 */
+		rc = build(p, &po, tgs, tgsz, argc, argv, asort);
+		break;
+	case (OP_INDEX):
+		/*
+		 * Split a regular amalgamation into pages, all from
+		 * one parse of the input files.
+		 */
+		memset(&idx, 0, sizeof(struct target));
+		idx.mode = TGT_INDEX;
+		idx.templ = NULL == templ ? "blog-template.xml" : templ;
+		idx.dst = NULL == outfile ? "blog.html" : outfile;
+		rc = build(p, &po, &idx, 1, argc, argv, asort);
 		break;
 	case (OP_LINK_INPLACE):
 		/*
@@ -207,7 +310,8 @@ main(int argc, char *argv[])
 		 */
 		if (NULL == templ)
 			templ = "blog-template.xml";
-		rc = linkall_r(p, templ, argc, argv, asort);
+		rc = linkall_r(p, &po, templ, 
+			argc, argv, outdir, asort);
 		break;
 	default:
 		/*
@@ -218,23 +322,49 @@ main(int argc, char *argv[])
 			templ = "blog-template.xml";
 		if (NULL == outfile)
 			outfile = "blog.html";
-		rc = linkall(p, templ, force, 
+		rc = linkall(p, &po, templ, force, 
 			argc, argv, outfile, asort);
 		break;
 	}
 
 	XML_ParserFree(p);
+	srclist_free(&srcs);
+	for (j = 0; j < tgsz; j++)
+		target_free(&tgs[j]);
+	free(tgs);
 	return(rc ? EXIT_SUCCESS : EXIT_FAILURE);
 usage:
+	for (j = 0; j < tgsz; j++)
+		target_free(&tgs[j]);
+	free(tgs);
+	free(dirs);
+	free(pats);
+	srclist_free(&srcs);
 	fprintf(stderr, 
-		"usage: %s [-o file] [-t templ] -c file...\n"
-		"       %s [-o file] [-t templ] [-s sort] -a file...\n"
-		"       %s [-jr] -l file...\n"
-		"       %s [-t templ] [-s sort] -L file...\n"
-		"       %s [-o file] [-s sort] -j file...\n"
-		"       %s [-o file] [-t templ] [-s sort] -C file...\n"
-		"       %s [-o file] [-t templ] [-s sort] file...\n",
-		progname, progname, progname, 
+		"usage: %s [-v] [-f list] [-p pat] [-R dir] [-d dir] "
+			"[-J jobs] [-o file] [-t templ] -c file...\n"
+		"       %s [-f list] [-p pat] [-R dir] [-J jobs] "
+			"[-K cache] [-o file] [-t templ] [-s sort] "
+			"-a file...\n"
+		"       %s [-f list] [-p pat] [-R dir] [-jr] [-J jobs] "
+			"[-K cache] -l file...\n"
+		"       %s [-v] [-f list] [-p pat] [-R dir] [-J jobs] "
+			"[-K cache] [-d dir] [-t templ] [-s sort] "
+			"-L file...\n"
+		"       %s [-f list] [-p pat] [-R dir] [-J jobs] "
+			"[-K cache] [-o file] [-s sort] -j file...\n"
+		"       %s [-f list] [-p pat] [-R dir] [-J jobs] "
+			"[-K cache] [-o file] [-t templ] [-s sort] "
+			"-C file...\n"
+		"       %s [-v] [-f list] [-p pat] [-R dir] [-J jobs] "
+			"[-K cache] [-o file] [-t templ] [-s sort] "
+			"-P file...\n"
+		"       %s [-f list] [-p pat] [-R dir] [-J jobs] "
+			"[-K cache] [-o file] [-t templ] [-s sort] "
+			"file...\n"
+		"       %s [-v] [-f list] [-p pat] [-R dir] [-J jobs] "
+			"[-K cache] [-s sort] -T target... file...\n",
+		progname, progname, progname, progname, progname,
 		progname, progname, progname, progname);
 	return(EXIT_FAILURE);
 }
@@ -0,0 +1,263 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <errno.h>
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <expat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+/*
+ * Size of the output buffer.
+ * Writes at least this large bypass the buffer.
+ */
+#define	OUT_BUFSZ	(64 * 1024)
+
+/*
+ * Buffered output to a file or standard output.
+ * This replaces stdio for our output: we never need formatting or
+ * locking, only appends of known length.
+ * In-memory outputs (see out_mem()) have no descriptor until closed.
+ */
+struct	out {
+	int		 fd; /* output descriptor or -1 if in memory */
+	char		*name; /* file name (for messages) */
+	char		*buf; /* pending output */
+	size_t		 sz; /* length of pending output */
+	size_t		 max; /* allocated buffer if in memory */
+	int		 error; /* a write has failed */
+};
+
+static void
+out_drain(struct out *o, const char *cp, size_t sz)
+{
+	ssize_t	 ssz;
+
+	while (sz > 0 && ! o->error) {
+		if (-1 == (ssz = write(o->fd, cp, sz))) {
+			if (EINTR == errno)
+				continue;
+			warn("%s", o->name);
+			o->error = 1;
+			break;
+		}
+		cp += ssz;
+		sz -= (size_t)ssz;
+	}
+}
+
+/*
+ * Open "fn" for writing, truncating it, or standard output if "-".
+ * Returns NULL on failure.
+ */
+struct out *
+out_open(const char *fn)
+{
+	struct out	*o;
+	int		 fd;
+
+	if (0 == strcmp(fn, "-"))
+		fd = STDOUT_FILENO;
+	else if (-1 == (fd = open(fn,
+	    O_WRONLY | O_CREAT | O_TRUNC, 0666))) {
+		warn("%s", fn);
+		return(NULL);
+	}
+
+	o = xcalloc(1, sizeof(struct out));
+	o->fd = fd;
+	o->name = xstrdup(fn);
+	o->max = OUT_BUFSZ;
+	o->buf = xmalloc(o->max);
+	return(o);
+}
+
+/*
+ * Like out_open(), but keep all output in memory until out_close(),
+ * which only then opens and writes "fn".
+ * This way, rendering and writing may happen in different threads.
+ */
+struct out *
+out_mem(const char *fn)
+{
+	struct out	*o;
+
+	o = xcalloc(1, sizeof(struct out));
+	o->fd = -1;
+	o->name = xstrdup(fn);
+	o->max = OUT_BUFSZ;
+	o->buf = xmalloc(o->max);
+	return(o);
+}
+
+/*
+ * Make room for "sz" more bytes of in-memory output.
+ */
+static void
+out_grow(struct out *o, size_t sz)
+{
+
+	if (o->sz + sz <= o->max)
+		return;
+	while (o->sz + sz > o->max)
+		o->max *= 2;
+	o->buf = xrealloc(o->buf, o->max);
+}
+
+/*
+ * Open the output file (or standard output) of in-memory output and
+ * write all of it.
+ * Returns zero on failure.
+ */
+static int
+out_commit(struct out *o)
+{
+
+	if (0 == strcmp(o->name, "-"))
+		o->fd = STDOUT_FILENO;
+	else if (-1 == (o->fd = open(o->name,
+	    O_WRONLY | O_CREAT | O_TRUNC, 0666))) {
+		warn("%s", o->name);
+		return(0);
+	}
+
+	out_drain(o, o->buf, o->sz);
+	o->sz = 0;
+
+	if (STDOUT_FILENO != o->fd && -1 == close(o->fd)) {
+		warn("%s", o->name);
+		return(0);
+	}
+	return( ! o->error);
+}
+
+/*
+ * Write all pending output.
+ * This does nothing for in-memory output.
+ * Returns zero if any write has failed.
+ */
+int
+out_flush(struct out *o)
+{
+
+	if (-1 == o->fd)
+		return( ! o->error);
+	out_drain(o, o->buf, o->sz);
+	o->sz = 0;
+	return( ! o->error);
+}
+
+/*
+ * Flush and close "o", which may be NULL.
+ * In-memory output is written only now (see out_mem()).
+ * Returns zero if any write has failed.
+ */
+int
+out_close(struct out *o)
+{
+	int	 rc;
+
+	if (NULL == o)
+		return(1);
+
+	if (-1 == o->fd)
+		rc = out_commit(o);
+	else {
+		rc = out_flush(o);
+		if (STDOUT_FILENO != o->fd && -1 == close(o->fd)) {
+			warn("%s", o->name);
+			rc = 0;
+		}
+	}
+
+	free(o->buf);
+	free(o->name);
+	free(o);
+	return(rc);
+}
+
+void
+out_write(struct out *o, const char *cp, size_t sz)
+{
+
+	if (-1 == o->fd)
+		out_grow(o, sz);
+
+	if (o->sz + sz <= o->max) {
+		memcpy(o->buf + o->sz, cp, sz);
+		o->sz += sz;
+		return;
+	}
+
+	out_flush(o);
+
+	if (sz >= OUT_BUFSZ)
+		out_drain(o, cp, sz);
+	else {
+		memcpy(o->buf, cp, sz);
+		o->sz = sz;
+	}
+}
+
+void
+out_puts(struct out *o, const char *cp)
+{
+
+	out_write(o, cp, strlen(cp));
+}
+
+void
+out_putc(struct out *o, char c)
+{
+
+	if (-1 == o->fd)
+		out_grow(o, 1);
+	else if (OUT_BUFSZ == o->sz)
+		out_flush(o);
+	o->buf[o->sz++] = c;
+}
+
+/*
+ * Print the decimal integer "v".
+ */
+void
+out_putll(struct out *o, long long v)
+{
+	char		 buf[24], *cp;
+	unsigned long long uv;
+
+	uv = v < 0 ? -(unsigned long long)v : (unsigned long long)v;
+	cp = buf + sizeof(buf);
+
+	do
+		*--cp = '0' + uv % 10;
+	while ((uv /= 10) > 0);
+
+	if (v < 0)
+		*--cp = '-';
+
+	out_write(o, cp, buf + sizeof(buf) - cp);
+}
@@ -23,6 +23,8 @@ enum	sort {
 	SORT_LAST
 };
 
+struct	arena;
+
 struct	article {
 	const char	 *src; /* source filename */
 	const char	 *stripsrc; /* source filename w/o directory */
@@ -52,6 +54,9 @@ struct	article {
 	char		 *img; /* image associated with article */
 	enum sort	  sort; /* overriden sort order parameters */
 	size_t		  order; /* cmdline sort order */
+	size_t		  bodyoff; /* offset in src of lazy article */
+	size_t		  bodysz; /* length in src (zero if not lazy) */
+	struct arena	 *arena; /* owns all article memory */
 };
 
 __BEGIN_DECLS
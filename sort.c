@@ -0,0 +1,397 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <errno.h>
+#include <expat.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * Locking for a set shared between threads (see artset_share()).
+ */
+struct	artsync {
+	pthread_mutex_t	 mutex;
+};
+
+/*
+ * Date orderings pack the class and time into a single unsigned key:
+ * the class in the top two bits, the (biased) time in the rest.
+ * Times beyond the 62-bit range are clamped.
+ */
+#define	KEY_CLASSBITS	62
+#define	KEY_TIMEBIAS	((int64_t)1 << (KEY_CLASSBITS - 1))
+#define	KEY_TIMEMAX	(((uint64_t)1 << KEY_CLASSBITS) - 1)
+
+/*
+ * Radix digits are bytes.
+ * A key has sizeof(size_t) digits of order (least significant) then
+ * eight digits of packed key.
+ */
+#define	RADIX_SIZE	256
+#define	RADIX_ORDER	(sizeof(size_t))
+#define	RADIX_DIGITS	(RADIX_ORDER + sizeof(uint64_t))
+
+struct	radixent {
+	uint64_t	 key; /* packed class and time */
+	size_t		 order; /* command-line order */
+	size_t		 idx; /* index in articles */
+};
+
+/*
+ * What we sort on for the filename and command-line orderings.
+ * Ties are always broken by command-line order, so every ordering is
+ * stable regardless of qsort(3) implementation.
+ */
+struct	sortkey {
+	int		 class; /* override class (ascending) */
+	size_t		 order; /* command-line order */
+	const char	*src; /* source file */
+	size_t		 idx; /* index in articles */
+};
+
+static int
+ordercmp(const struct sortkey *k1, const struct sortkey *k2)
+{
+
+	if (k1->order != k2->order)
+		return(k1->order < k2->order ? -1 : 1);
+	return(0);
+}
+
+static int
+cmdlinecmp(const void *p1, const void *p2)
+{
+
+	return(ordercmp(p1, p2));
+}
+
+static int
+filenamecmp(const void *p1, const void *p2)
+{
+	const struct sortkey *k1 = p1, *k2 = p2;
+	int	 rc;
+
+	if (k1->class != k2->class)
+		return(k1->class < k2->class ? -1 : 1);
+	if (0 != (rc = strcmp(k1->src, k2->src)))
+		return(rc);
+	return(ordercmp(k1, k2));
+}
+
+/*
+ * The class orders SORT_FIRST before regular articles before
+ * SORT_LAST, or the reverse for reverse date ordering.
+ */
+static int
+artclass(const struct article *art, enum asort asort)
+{
+	int	 class;
+
+	switch (art->sort) {
+	case (SORT_FIRST):
+		class = 0;
+		break;
+	case (SORT_LAST):
+		class = 2;
+		break;
+	default:
+		class = 1;
+		break;
+	}
+
+	return(ASORT_RDATE == asort ? 2 - class : class);
+}
+
+static uint64_t
+datekey(const struct article *art, enum asort asort)
+{
+	int64_t		 t = art->time;
+	uint64_t	 v;
+
+	if (t < -KEY_TIMEBIAS)
+		v = 0;
+	else if (t >= KEY_TIMEBIAS)
+		v = KEY_TIMEMAX;
+	else
+		v = (uint64_t)(t + KEY_TIMEBIAS);
+
+	/* Newest first. */
+
+	if (ASORT_DATE == asort)
+		v = KEY_TIMEMAX - v;
+
+	return((uint64_t)artclass(art, asort) << KEY_CLASSBITS | v);
+}
+
+static size_t
+radixdigit(const struct radixent *e, size_t d)
+{
+
+	if (d < RADIX_ORDER)
+		return((e->order >> (d * 8)) & 0xff);
+	return((e->key >> ((d - RADIX_ORDER) * 8)) & 0xff);
+}
+
+/*
+ * Stable least-significant-digit radix sort of "ents" (using "tmp" of
+ * the same size as scratch) on key, then order.
+ * Digits that are the same across all entries are skipped, as are the
+ * order digits if "ordered" (entries are already in order).
+ * Returns the array containing the result.
+ */
+static struct radixent *
+radixsort(struct radixent *ents, struct radixent *tmp, 
+	size_t n, int ordered)
+{
+	size_t		  count[RADIX_DIGITS][RADIX_SIZE];
+	size_t		  i, d, sum, c;
+	struct radixent	 *swap;
+
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < n; i++)
+		for (d = ordered ? RADIX_ORDER : 0; d < RADIX_DIGITS; d++)
+			count[d][radixdigit(&ents[i], d)]++;
+
+	for (d = ordered ? RADIX_ORDER : 0; d < RADIX_DIGITS; d++) {
+		if (count[d][radixdigit(&ents[0], d)] == n)
+			continue;
+		for (sum = i = 0; i < RADIX_SIZE; i++) {
+			c = count[d][i];
+			count[d][i] = sum;
+			sum += c;
+		}
+		for (i = 0; i < n; i++)
+			tmp[count[d][radixdigit(&ents[i], d)]++] = ents[i];
+		swap = ents;
+		ents = tmp;
+		tmp = swap;
+	}
+
+	return(ents);
+}
+
+/*
+ * Date orderings are by far the most common, so use a radix sort over
+ * keys packing the class and time.
+ */
+static size_t *
+sortdate(const struct artset *s, enum asort asort)
+{
+	struct radixent	*ents, *tmp, *res;
+	size_t		*perm;
+	size_t		 i;
+	int		 ordered = 1;
+
+	ents = xcalloc(s->artsz, sizeof(struct radixent));
+	tmp = xcalloc(s->artsz, sizeof(struct radixent));
+
+	for (i = 0; i < s->artsz; i++) {
+		ents[i].key = datekey(&s->arts[i], asort);
+		ents[i].order = s->arts[i].order;
+		ents[i].idx = i;
+		if (i > 0 && ents[i].order < ents[i - 1].order)
+			ordered = 0;
+	}
+
+	res = 0 == s->artsz ? ents :
+		radixsort(ents, tmp, s->artsz, ordered);
+
+	perm = xcalloc(s->artsz, sizeof(size_t));
+	for (i = 0; i < s->artsz; i++)
+		perm[i] = res[i].idx;
+
+	free(ents);
+	free(tmp);
+	return(perm);
+}
+
+static size_t *
+sortkeys(const struct artset *s, enum asort asort)
+{
+	struct sortkey	*keys;
+	size_t		*perm;
+	size_t		 i;
+
+	keys = xcalloc(s->artsz, sizeof(struct sortkey));
+	for (i = 0; i < s->artsz; i++) {
+		keys[i].class = artclass(&s->arts[i], asort);
+		keys[i].order = s->arts[i].order;
+		keys[i].src = s->arts[i].src;
+		keys[i].idx = i;
+	}
+
+	qsort(keys, s->artsz, sizeof(struct sortkey), 
+		ASORT_FILENAME == asort ? filenamecmp : cmdlinecmp);
+
+	perm = xcalloc(s->artsz, sizeof(size_t));
+	for (i = 0; i < s->artsz; i++)
+		perm[i] = keys[i].idx;
+
+	free(keys);
+	return(perm);
+}
+
+/*
+ * Initialise "s" over the articles "arts" of length "artsz".
+ * No orderings are computed until asked for.
+ */
+void
+artset_init(struct artset *s, const struct article *arts, size_t artsz)
+{
+
+	memset(s, 0, sizeof(struct artset));
+	s->arts = arts;
+	s->artsz = artsz;
+}
+
+/*
+ * Get the permutation of article indices in the order "asort",
+ * computing it if it's the first time asked.
+ * The result is owned by "s".
+ */
+const size_t *
+artset_order(struct artset *s, enum asort asort)
+{
+
+	if (NULL != s->order[asort])
+		return(s->order[asort]);
+
+	if (ASORT_DATE == asort || ASORT_RDATE == asort)
+		s->order[asort] = sortdate(s, asort);
+	else
+		s->order[asort] = sortkeys(s, asort);
+
+	return(s->order[asort]);
+}
+
+static const char *
+body_get(struct artset *s, size_t idx)
+{
+	struct sbuf	 buf;
+
+	if (NULL == s->bodies)
+		s->bodies = xcalloc(s->artsz, sizeof(char *));
+	if (NULL != s->bodies[idx])
+		return(s->bodies[idx]);
+
+	if (NULL == s->p && NULL == (s->p = XML_ParserCreate(NULL)))
+		err(EXIT_FAILURE, "XML_ParserCreate");
+
+	memset(&buf, 0, sizeof(struct sbuf));
+	if (sblg_parse_body(s->p, &s->arts[idx], &buf) && NULL != buf.p)
+		s->bodies[idx] = buf.p;
+	else {
+		sbuf_free(&buf);
+		s->bodies[idx] = xstrdup("");
+	}
+
+	return(s->bodies[idx]);
+}
+
+/*
+ * Get the body of article "idx".
+ * If it was parsed lazily (see PBODY_LAZY), read it in from its source
+ * the first time it's asked for; an unreadable body is empty.
+ * The result is owned by "s".
+ */
+const char *
+artset_body(struct artset *s, size_t idx)
+{
+	const char	*cp;
+
+	if (NULL != s->arts[idx].article)
+		return(s->arts[idx].article);
+
+	artset_lock(s);
+	cp = body_get(s, idx);
+	artset_unlock(s);
+	return(cp);
+}
+
+/*
+ * Make "s" safe to share between threads rendering from it.
+ * Article bodies and dates are filled in under a lock from now on.
+ * Orderings and tag queries are not: compute those that will be used
+ * beforehand (see tmpl_prepare()).
+ */
+void
+artset_share(struct artset *s)
+{
+	int	 er;
+
+	if (NULL != s->sync)
+		return;
+
+	s->sync = xcalloc(1, sizeof(struct artsync));
+	if (0 != (er = pthread_mutex_init(&s->sync->mutex, NULL))) {
+		errno = er;
+		err(EXIT_FAILURE, "pthread_mutex_init");
+	}
+}
+
+void
+artset_lock(struct artset *s)
+{
+
+	if (NULL != s->sync)
+		pthread_mutex_lock(&s->sync->mutex);
+}
+
+void
+artset_unlock(struct artset *s)
+{
+
+	if (NULL != s->sync)
+		pthread_mutex_unlock(&s->sync->mutex);
+}
+
+/*
+ * Free the orderings, index, bodies, and dates of "s" (not the
+ * articles).
+ */
+void
+artset_free(struct artset *s)
+{
+	size_t	 i;
+
+	for (i = 0; i < ASORT__MAX; i++)
+		free(s->order[i]);
+	tagidx_free(s->tagidx);
+
+	if (NULL != s->bodies)
+		for (i = 0; i < s->artsz; i++)
+			free(s->bodies[i]);
+	free(s->bodies);
+	if (NULL != s->p)
+		XML_ParserFree(s->p);
+	datecache_free(s->dates, s->artsz);
+
+	if (NULL != s->sync) {
+		pthread_mutex_destroy(&s->sync->mutex);
+		free(s->sync);
+	}
+}
@@ -0,0 +1,393 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if HAVE_FTS
+# include <fts.h>
+#else
+# include <dirent.h>
+#endif
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <errno.h>
+#include <expat.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+/*
+ * Input file names, gathered from the command line, list files (see
+ * srclist_file()), and directory walks (see srclist_dir()).
+ * Names read from files or walks live in one arena; those from the
+ * command line are not copied.
+ */
+
+/*
+ * A thread checking every "stride"-th candidate from "start" (see
+ * srclist_dir()).
+ */
+struct	srcstat {
+	pthread_t	  thread;
+	char		**v; /* candidate names */
+	int		 *keep; /* whether each is a regular file */
+	size_t		  sz; /* number of candidates */
+	size_t		  start; /* first candidate */
+	size_t		  stride; /* step between candidates */
+};
+
+static void
+srclist_add(struct srclist *l, char *name)
+{
+
+	if (l->sz == l->max) {
+		l->max = 0 == l->max ? 64 : l->max * 2;
+		l->v = xreallocarray(l->v, l->max, sizeof(char *));
+	}
+	l->v[l->sz++] = name;
+}
+
+/*
+ * Append the "argc" names in "argv".
+ */
+void
+srclist_argv(struct srclist *l, int argc, char *argv[])
+{
+	int	 i;
+
+	for (i = 0; i < argc; i++)
+		srclist_add(l, argv[i]);
+}
+
+/*
+ * Append the names listed in "f", or standard input if "-".
+ * Names are separated by newlines or, if there are any nil bytes in
+ * the list (as from find -print0), by those instead.
+ * Empty names are skipped.
+ * Returns zero on failure (having reported it).
+ */
+int
+srclist_file(struct srclist *l, const char *f)
+{
+	struct sbuf	 buf;
+	char		 chunk[INPUT_CHUNK];
+	char		*cp, *end, *next;
+	ssize_t		 ssz;
+	int		 fd, sep, rc = 0;
+
+	memset(&buf, 0, sizeof(struct sbuf));
+
+	if (0 == strcmp(f, "-"))
+		fd = STDIN_FILENO;
+	else if (-1 == (fd = open(f, O_RDONLY, 0))) {
+		warn("%s", f);
+		return(0);
+	}
+
+	for (;;) {
+		if (-1 == (ssz = read(fd, chunk, sizeof(chunk)))) {
+			if (EINTR == errno)
+				continue;
+			warn("%s", f);
+			goto out;
+		} else if (0 == ssz)
+			break;
+		sbuf_append(&buf, chunk, (size_t)ssz);
+	}
+
+	if (0 == buf.sz) {
+		rc = 1;
+		goto out;
+	}
+
+	if (NULL == l->arena)
+		l->arena = arena_alloc();
+
+	cp = arena_malloc(l->arena, buf.sz + 1);
+	memcpy(cp, buf.p, buf.sz);
+	end = cp + buf.sz;
+	*end = '\0';
+
+	sep = NULL != memchr(cp, '\0', buf.sz) ? '\0' : '\n';
+
+	for ( ; cp < end; cp = next + 1) {
+		if (NULL == (next = memchr(cp, sep, end - cp)))
+			next = end;
+		*next = '\0';
+		if (next > cp)
+			srclist_add(l, cp);
+	}
+
+	if (l->sz > INT_MAX) {
+		warnx("%s: too many files", f);
+		goto out;
+	}
+
+	rc = 1;
+out:
+	if (STDIN_FILENO != fd)
+		close(fd);
+	sbuf_free(&buf);
+	return(rc);
+}
+
+void
+srclist_free(struct srclist *l)
+{
+
+	free(l->v);
+	if (NULL != l->arena)
+		arena_free(l->arena);
+	memset(l, 0, sizeof(struct srclist));
+}
+
+static void *
+srcstat_worker(void *dat)
+{
+	struct srcstat	*w = dat;
+	struct stat	 st;
+	size_t		 i;
+
+	for (i = w->start; i < w->sz; i += w->stride)
+		if (-1 == stat(w->v[i], &st))
+			warn("%s", w->v[i]);
+		else
+			w->keep[i] = S_ISREG(st.st_mode);
+
+	return(NULL);
+}
+
+static int
+srcnamecmp(const void *p1, const void *p2)
+{
+
+	return(strcmp(*(char *const *)p1, *(char *const *)p2));
+}
+
+/*
+ * Whether "name" matches any of the "patsz" fnmatch(3) patterns "pats".
+ */
+static int
+srcmatch(const char *name, const char *const *pats, size_t patsz)
+{
+	size_t	 i;
+
+	for (i = 0; i < patsz; i++)
+		if (0 == fnmatch(pats[i], name, 0))
+			return(1);
+	return(0);
+}
+
+#if HAVE_FTS
+/*
+ * Append the candidates under "dir" (see srclist_dir()).
+ * Returns zero on failure (having reported it).
+ */
+static int
+srcwalk(struct srclist *l, const char *dir, 
+	const char *const *pats, size_t patsz)
+{
+	FTS		 *fts;
+	FTSENT		 *ent;
+	char		 *roots[2];
+	int		  rc = 0;
+
+	roots[0] = (char *)dir;
+	roots[1] = NULL;
+
+	fts = fts_open(roots, 
+		FTS_PHYSICAL | FTS_NOCHDIR | FTS_NOSTAT, NULL);
+	if (NULL == fts) {
+		warn("%s", dir);
+		return(0);
+	}
+
+	for (;;) {
+		errno = 0;
+		if (NULL == (ent = fts_read(fts)))
+			break;
+		switch (ent->fts_info) {
+		case (FTS_DNR):
+		case (FTS_ERR):
+		case (FTS_NS):
+			warnx("%s: %s", ent->fts_path, 
+				strerror(ent->fts_errno));
+			goto out;
+		case (FTS_D):
+		case (FTS_DC):
+		case (FTS_DP):
+			continue;
+		default:
+			break;
+		}
+		if (srcmatch(ent->fts_name, pats, patsz))
+			srclist_add(l, 
+				arena_strdup(l->arena, ent->fts_path));
+	}
+
+	if (0 != errno) {
+		warn("%s", dir);
+		goto out;
+	}
+
+	rc = 1;
+out:
+	fts_close(fts);
+	return(rc);
+}
+#else
+/*
+ * Like the above, but with readdir(3) for systems without fts(3).
+ * Entries are lstat(2)'d so as not to follow links to directories.
+ */
+static int
+srcwalk(struct srclist *l, const char *dir, 
+	const char *const *pats, size_t patsz)
+{
+	DIR		 *d;
+	struct dirent	 *dp;
+	struct stat	  st;
+	struct sbuf	  path;
+	size_t		  sz;
+	int		  rc = 0;
+
+	if (NULL == (d = opendir(dir))) {
+		warn("%s", dir);
+		return(0);
+	}
+
+	memset(&path, 0, sizeof(struct sbuf));
+	sz = strlen(dir);
+	if (sz > 0 && '/' == dir[sz - 1])
+		sz--;
+
+	for (;;) {
+		errno = 0;
+		if (NULL == (dp = readdir(d)))
+			break;
+		if (0 == strcmp(dp->d_name, ".") ||
+		    0 == strcmp(dp->d_name, ".."))
+			continue;
+
+		sbuf_reset(&path);
+		sbuf_append(&path, dir, sz);
+		sbuf_putc(&path, '/');
+		sbuf_puts(&path, dp->d_name);
+
+		if (-1 == lstat(path.p, &st)) {
+			warn("%s", path.p);
+			goto out;
+		} else if (S_ISDIR(st.st_mode)) {
+			if ( ! srcwalk(l, path.p, pats, patsz))
+				goto out;
+		} else if (srcmatch(dp->d_name, pats, patsz))
+			srclist_add(l, arena_strdup(l->arena, path.p));
+	}
+
+	if (0 != errno) {
+		warn("%s", dir);
+		goto out;
+	}
+
+	rc = 1;
+out:
+	sbuf_free(&path);
+	closedir(d);
+	return(rc);
+}
+#endif
+
+/*
+ * Append the files under directory "dir" whose names match any of the
+ * "patsz" fnmatch(3) patterns in "pats".
+ * Symbolic links are followed for files but not for directories.
+ * The walk itself doesn't stat(2) files: candidates are checked to be
+ * regular files afterward, by up to "jobs" threads at once.
+ * Names are appended in strcmp(3) order, so the command-line order of
+ * a tree doesn't depend on how its file-system lists directories.
+ * Returns zero on failure (having reported it).
+ */
+int
+srclist_dir(struct srclist *l, const char *dir, 
+	const char *const *pats, size_t patsz, size_t jobs)
+{
+	struct srcstat	 *w;
+	int		 *keep;
+	size_t		  i, j, base, sz, nthreads;
+	int		  er;
+
+	if (NULL == l->arena)
+		l->arena = arena_alloc();
+
+	base = l->sz;
+	if ( ! srcwalk(l, dir, pats, patsz))
+		return(0);
+
+	if (0 == (sz = l->sz - base))
+		return(1);
+
+	keep = xcalloc(sz, sizeof(int));
+	nthreads = jobs < sz ? jobs : sz;
+	if (0 == nthreads)
+		nthreads = 1;
+	w = xcalloc(nthreads, sizeof(struct srcstat));
+
+	for (i = 0; i < nthreads; i++) {
+		w[i].v = l->v + base;
+		w[i].keep = keep;
+		w[i].sz = sz;
+		w[i].start = i;
+		w[i].stride = nthreads;
+		er = pthread_create(&w[i].thread, 
+			NULL, srcstat_worker, &w[i]);
+		if (0 != er) {
+			errno = er;
+			err(EXIT_FAILURE, "pthread_create");
+		}
+	}
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(w[i].thread, NULL);
+
+	for (i = j = 0; i < sz; i++)
+		if (keep[i])
+			l->v[base + j++] = l->v[base + i];
+	l->sz = base + j;
+
+	qsort(l->v + base, j, sizeof(char *), srcnamecmp);
+
+	free(w);
+	free(keep);
+
+	if (l->sz > INT_MAX) {
+		warnx("%s: too many files", dir);
+		return(0);
+	}
+
+	return(1);
+}
@@ -0,0 +1,338 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <assert.h>
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <errno.h>
+#include <expat.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * Pipelines of stages (parse, render, write) connected by bounded
+ * queues, so that memory is limited to a few items per thread and one
+ * stage's input and output overlap another's work.
+ * Each stage keeps statistics of its threads' time for -v.
+ */
+
+/*
+ * A first-in first-out queue of at most "max" items.
+ * Getting blocks while it's empty until an item is put or all of its
+ * producers are done; putting blocks while it's full.
+ */
+struct	queue {
+	void		**items; /* ring of pending items */
+	size_t		  max; /* capacity */
+	size_t		  first; /* position of the oldest item */
+	size_t		  sz; /* number of pending items */
+	size_t		  producers; /* producers not yet done */
+	pthread_mutex_t	  mutex; /* guards all of the above */
+	pthread_cond_t	  notempty; /* signalled on put or done */
+	pthread_cond_t	  notfull; /* signalled on get */
+};
+
+/*
+ * Statistics of the threads running a stage.
+ */
+struct	stage {
+	const char	*name; /* for printing */
+	size_t		 threads; /* threads having run it */
+	size_t		 items; /* items processed */
+	double		 busy; /* seconds working */
+	double		 wait; /* seconds blocked on queues */
+	pthread_mutex_t	 mutex; /* guards all of the above */
+};
+
+/*
+ * The writer stage: a thread closing (i.e., committing) outputs as
+ * they're put into its queue.
+ */
+struct	writer {
+	struct queue	*q; /* outputs to close */
+	struct stage	*st; /* statistics or NULL */
+	pthread_t	 thread; /* the writer */
+	int		 failed; /* whether any output failed */
+};
+
+static void
+xpthread(int er, const char *func)
+{
+
+	if (0 != er) {
+		errno = er;
+		err(EXIT_FAILURE, "%s", func);
+	}
+}
+
+/*
+ * Seconds on a monotonic clock.
+ */
+double
+stage_time(void)
+{
+	struct timespec	 ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+struct stage *
+stage_alloc(const char *name)
+{
+	struct stage	*st;
+
+	st = xcalloc(1, sizeof(struct stage));
+	st->name = name;
+	xpthread(pthread_mutex_init(&st->mutex, NULL),
+		"pthread_mutex_init");
+	return(st);
+}
+
+void
+stage_free(struct stage *st)
+{
+
+	if (NULL == st)
+		return;
+	pthread_mutex_destroy(&st->mutex);
+	free(st);
+}
+
+/*
+ * Account for a thread of the stage having processed "items" in "busy"
+ * seconds of work and "wait" seconds blocked.
+ * "st" may be NULL.
+ */
+void
+stage_add(struct stage *st, size_t items, double busy, double wait)
+{
+
+	if (NULL == st)
+		return;
+	pthread_mutex_lock(&st->mutex);
+	st->threads++;
+	st->items += items;
+	st->busy += busy;
+	st->wait += wait;
+	pthread_mutex_unlock(&st->mutex);
+}
+
+/*
+ * Print the statistics of the stage to standard error.
+ * Utilisation is the fraction of the "wall" seconds over which the
+ * pipeline ran that its threads spent working.
+ * "st" may be NULL.
+ */
+void
+stage_print(const struct stage *st, double wall)
+{
+	double	 use = 0.0;
+
+	if (NULL == st)
+		return;
+	if (st->threads > 0 && wall > 0.0)
+		use = 100.0 * st->busy / (st->threads * wall);
+
+	fprintf(stderr, "%s: %s: items %zu, threads %zu, "
+		"busy %.3f s, blocked %.3f s, utilised %.0f%%\n",
+		getprogname(), st->name, st->items, st->threads,
+		st->busy, st->wait, use);
+}
+
+/*
+ * A queue holding up to "max" items (at least one) from "producers",
+ * each of which must call queue_done() when finished.
+ */
+struct queue *
+queue_alloc(size_t max, size_t producers)
+{
+	struct queue	*q;
+
+	q = xcalloc(1, sizeof(struct queue));
+	q->max = max > 0 ? max : 1;
+	q->items = xcalloc(q->max, sizeof(void *));
+	q->producers = producers;
+	xpthread(pthread_mutex_init(&q->mutex, NULL),
+		"pthread_mutex_init");
+	xpthread(pthread_cond_init(&q->notempty, NULL),
+		"pthread_cond_init");
+	xpthread(pthread_cond_init(&q->notfull, NULL),
+		"pthread_cond_init");
+	return(q);
+}
+
+/*
+ * Free the queue, which must be empty.
+ */
+void
+queue_free(struct queue *q)
+{
+
+	if (NULL == q)
+		return;
+	assert(0 == q->sz);
+	pthread_cond_destroy(&q->notfull);
+	pthread_cond_destroy(&q->notempty);
+	pthread_mutex_destroy(&q->mutex);
+	free(q->items);
+	free(q);
+}
+
+/*
+ * Append "item", waiting for room if full.
+ * Seconds spent waiting are added to "wait".
+ */
+void
+queue_put(struct queue *q, void *item, double *wait)
+{
+	double	 start;
+
+	pthread_mutex_lock(&q->mutex);
+	if (q->sz == q->max) {
+		start = stage_time();
+		while (q->sz == q->max)
+			pthread_cond_wait(&q->notfull, &q->mutex);
+		*wait += stage_time() - start;
+	}
+	q->items[(q->first + q->sz++) % q->max] = item;
+	pthread_cond_signal(&q->notempty);
+	pthread_mutex_unlock(&q->mutex);
+}
+
+/*
+ * Take the oldest item, waiting for one if empty.
+ * Seconds spent waiting are added to "wait".
+ * Returns NULL once empty with all producers done.
+ */
+void *
+queue_get(struct queue *q, double *wait)
+{
+	double	 start;
+	void	*item = NULL;
+
+	pthread_mutex_lock(&q->mutex);
+	if (0 == q->sz && q->producers > 0) {
+		start = stage_time();
+		while (0 == q->sz && q->producers > 0)
+			pthread_cond_wait(&q->notempty, &q->mutex);
+		*wait += stage_time() - start;
+	}
+	if (q->sz > 0) {
+		item = q->items[q->first];
+		q->first = (q->first + 1) % q->max;
+		q->sz--;
+		pthread_cond_signal(&q->notfull);
+	}
+	pthread_mutex_unlock(&q->mutex);
+	return(item);
+}
+
+/*
+ * Note that one of the queue's producers is finished.
+ */
+void
+queue_done(struct queue *q)
+{
+
+	pthread_mutex_lock(&q->mutex);
+	assert(q->producers > 0);
+	if (0 == --q->producers)
+		pthread_cond_broadcast(&q->notempty);
+	pthread_mutex_unlock(&q->mutex);
+}
+
+static void *
+writer_worker(void *dat)
+{
+	struct writer	*w = dat;
+	struct out	*o;
+	size_t		 items = 0;
+	double		 start, wait = 0.0;
+
+	start = stage_time();
+	while (NULL != (o = queue_get(w->q, &wait))) {
+		if ( ! out_close(o))
+			w->failed = 1;
+		items++;
+	}
+	stage_add(w->st, items, stage_time() - start - wait, wait);
+	return(NULL);
+}
+
+/*
+ * Start a writer thread closing outputs put by writer_put() from
+ * "producers", with at most "max" of them pending.
+ * Statistics are kept in "st", if not NULL.
+ */
+struct writer *
+writer_alloc(size_t max, size_t producers, struct stage *st)
+{
+	struct writer	*w;
+
+	w = xcalloc(1, sizeof(struct writer));
+	w->q = queue_alloc(max, producers);
+	w->st = st;
+	xpthread(pthread_create(&w->thread, NULL, writer_worker, w),
+		"pthread_create");
+	return(w);
+}
+
+/*
+ * Pass the output "o" to the writer to be closed.
+ * This is usually an in-memory output (see out_mem()).
+ */
+void
+writer_put(struct writer *w, struct out *o, double *wait)
+{
+
+	queue_put(w->q, o, wait);
+}
+
+/*
+ * Note that one of the writer's producers is finished.
+ */
+void
+writer_done(struct writer *w)
+{
+
+	queue_done(w->q);
+}
+
+/*
+ * Wait for the writer to finish, which it does after all producers are
+ * done, and free it.
+ * Returns zero if any output failed.
+ */
+int
+writer_free(struct writer *w)
+{
+	int	 rc;
+
+	pthread_join(w->thread, NULL);
+	rc = ! w->failed;
+	queue_free(w->q);
+	free(w);
+	return(rc);
+}
@@ -0,0 +1,171 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <expat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * A map from strings to dense integer identifiers, assigned in order of
+ * insertion starting at zero.
+ * Keys are not copied: they must outlive the map.
+ * This is open addressing with linear probing over a power-of-two table
+ * kept at most half full.
+ */
+struct	strmap {
+	const char	**keys; /* keys by identifier */
+	size_t		  keysz; /* number of keys */
+	size_t		  keymax; /* allocated keys */
+	size_t		 *slots; /* identifier + 1 or zero if empty */
+	size_t		  slotsz; /* number of slots */
+};
+
+#define	STRMAP_INIT	64
+
+static size_t
+strmap_hash(const char *key)
+{
+	unsigned long long	 h = 14695981039346656037ULL;
+
+	for ( ; '\0' != *key; key++) {
+		h ^= (unsigned char)*key;
+		h *= 1099511628211ULL;
+	}
+
+	return((size_t)h);
+}
+
+/*
+ * Return the slot either holding "key" or where it would go.
+ */
+static size_t
+strmap_slot(const struct strmap *m, const char *key)
+{
+	size_t	 i, mask = m->slotsz - 1;
+
+	i = strmap_hash(key) & mask;
+	while (0 != m->slots[i] && 
+	       strcmp(m->keys[m->slots[i] - 1], key))
+		i = (i + 1) & mask;
+
+	return(i);
+}
+
+static void
+strmap_grow(struct strmap *m)
+{
+	size_t	 i, j, mask;
+
+	free(m->slots);
+	m->slotsz *= 2;
+	m->slots = xcalloc(m->slotsz, sizeof(size_t));
+	mask = m->slotsz - 1;
+
+	for (i = 0; i < m->keysz; i++) {
+		j = strmap_hash(m->keys[i]) & mask;
+		while (0 != m->slots[j])
+			j = (j + 1) & mask;
+		m->slots[j] = i + 1;
+	}
+}
+
+struct strmap *
+strmap_alloc(void)
+{
+	struct strmap	*m;
+
+	m = xcalloc(1, sizeof(struct strmap));
+	m->slotsz = STRMAP_INIT;
+	m->slots = xcalloc(m->slotsz, sizeof(size_t));
+	return(m);
+}
+
+void
+strmap_free(struct strmap *m)
+{
+
+	if (NULL == m)
+		return;
+	free(m->keys);
+	free(m->slots);
+	free(m);
+}
+
+/*
+ * Look up "key", returning its identifier or STRMAP_NONE.
+ */
+size_t
+strmap_get(const struct strmap *m, const char *key)
+{
+	size_t	 i;
+
+	i = strmap_slot(m, key);
+	return(0 == m->slots[i] ? STRMAP_NONE : m->slots[i] - 1);
+}
+
+/*
+ * Look up "key", adding it if not found.
+ * Returns its identifier.
+ */
+size_t
+strmap_put(struct strmap *m, const char *key)
+{
+	size_t	 i;
+
+	i = strmap_slot(m, key);
+	if (0 != m->slots[i])
+		return(m->slots[i] - 1);
+
+	if (m->keysz == m->keymax) {
+		m->keymax = 0 == m->keymax ? 16 : m->keymax * 2;
+		m->keys = xreallocarray(m->keys,
+			m->keymax, sizeof(const char *));
+	}
+
+	m->keys[m->keysz] = key;
+	m->slots[i] = ++m->keysz;
+
+	if (m->keysz * 2 > m->slotsz)
+		strmap_grow(m);
+
+	return(m->keysz - 1);
+}
+
+/*
+ * Number of keys in the map: identifiers are less than this.
+ */
+size_t
+strmap_size(const struct strmap *m)
+{
+
+	return(m->keysz);
+}
+
+/*
+ * The key with identifier "id".
+ */
+const char *
+strmap_key(const struct strmap *m, size_t id)
+{
+
+	return(m->keys[id]);
+}
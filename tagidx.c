@@ -0,0 +1,321 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <expat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * The set of article positions (in one ordering) having at least one
+ * of a list of tags, as a bitset.
+ * These are cached by their tag list, which comes from a template and
+ * so is the same pointer for all outputs.
+ */
+struct	tagq {
+	enum asort	  asort; /* ordering of positions */
+	char		**tags; /* tags queried */
+	size_t		  tagsz; /* number of tags */
+	uint64_t	 *bits; /* bit per position */
+	size_t		  sz; /* number of positions */
+};
+
+/*
+ * Index of tags for an article set: built on first query.
+ * Tags are interned across the set, so each article's tags and each
+ * tag's articles (its posting) are arrays of integers.
+ * Both are packed: the tags of article "i" are "ids" from offs[i] to
+ * offs[i + 1], and the articles with tag "id" (in increasing order) are
+ * "posts" from postoffs[id] to postoffs[id + 1].
+ */
+struct	tagidx {
+	struct strmap	 *map; /* tag to identifier */
+	size_t		 *ids; /* tag identifiers per article */
+	size_t		 *offs; /* offsets into ids by article */
+	size_t		 *posts; /* article indices per tag */
+	size_t		 *postoffs; /* offsets into posts by tag */
+	size_t		 *ranks[ASORT__MAX]; /* inverse orderings */
+	struct tagq	**qs; /* cached queries */
+	size_t		  qsz; /* number of queries */
+};
+
+static struct tagidx *
+tagidx_alloc(const struct artset *s)
+{
+	struct tagidx	*x;
+	size_t		*cur;
+	size_t		 i, j, k, n, tagsz;
+
+	x = xcalloc(1, sizeof(struct tagidx));
+	x->map = strmap_alloc();
+	x->offs = xcalloc(s->artsz + 1, sizeof(size_t));
+
+	for (n = i = 0; i < s->artsz; i++)
+		n += s->arts[i].tagmapsz;
+
+	x->ids = xcalloc(n, sizeof(size_t));
+	x->posts = xcalloc(n, sizeof(size_t));
+
+	/* Intern each article's tags. */
+
+	for (k = i = 0; i < s->artsz; i++) {
+		x->offs[i] = k;
+		for (j = 0; j < s->arts[i].tagmapsz; j++)
+			x->ids[k++] = strmap_put(x->map, 
+				s->arts[i].tagmap[j]);
+	}
+	x->offs[i] = k;
+
+	tagsz = strmap_size(x->map);
+	x->postoffs = xcalloc(tagsz + 1, sizeof(size_t));
+	for (k = 0; k < n; k++)
+		x->postoffs[x->ids[k] + 1]++;
+	for (i = 0; i < tagsz; i++)
+		x->postoffs[i + 1] += x->postoffs[i];
+
+	/* Fill postings in article order. */
+
+	cur = xcalloc(tagsz + 1, sizeof(size_t));
+	memcpy(cur, x->postoffs, (tagsz + 1) * sizeof(size_t));
+	for (i = 0; i < s->artsz; i++)
+		for (k = x->offs[i]; k < x->offs[i + 1]; k++)
+			x->posts[cur[x->ids[k]]++] = i;
+	free(cur);
+
+	return(x);
+}
+
+/*
+ * Free the tag index "x", which may be NULL.
+ */
+void
+tagidx_free(struct tagidx *x)
+{
+	size_t	 i;
+
+	if (NULL == x)
+		return;
+
+	for (i = 0; i < ASORT__MAX; i++)
+		free(x->ranks[i]);
+	for (i = 0; i < x->qsz; i++) {
+		free(x->qs[i]->bits);
+		free(x->qs[i]);
+	}
+
+	strmap_free(x->map);
+	free(x->ids);
+	free(x->offs);
+	free(x->posts);
+	free(x->postoffs);
+	free(x->qs);
+	free(x);
+}
+
+static struct tagidx *
+artset_tagidx(struct artset *s)
+{
+
+	if (NULL == s->tagidx)
+		s->tagidx = tagidx_alloc(s);
+	return(s->tagidx);
+}
+
+/*
+ * Number of distinct tags in "s".
+ * Tag identifiers are less than this, assigned in order of first
+ * appearance.
+ */
+size_t
+artset_tagsz(struct artset *s)
+{
+
+	return(strmap_size(artset_tagidx(s)->map));
+}
+
+/*
+ * The name of the tag with identifier "id".
+ */
+const char *
+artset_tagname(struct artset *s, size_t id)
+{
+
+	return(strmap_key(artset_tagidx(s)->map, id));
+}
+
+/*
+ * The indices of articles with the tag "id", in increasing order.
+ * Its length is set in "sz".
+ */
+const size_t *
+artset_tagged(struct artset *s, size_t id, size_t *sz)
+{
+	const struct tagidx *x = artset_tagidx(s);
+
+	*sz = x->postoffs[id + 1] - x->postoffs[id];
+	return(x->posts + x->postoffs[id]);
+}
+
+/*
+ * Get the positions in ordering "asort" of the articles having any of
+ * the "tags" of length "tagsz".
+ * Returns NULL if "tagsz" is zero, meaning all articles.
+ * The result is owned by "s".
+ */
+const struct tagq *
+artset_tagq(struct artset *s, enum asort asort, 
+	char **tags, size_t tagsz)
+{
+	struct tagidx	*x;
+	struct tagq	*q;
+	const size_t	*perm;
+	size_t		 i, j, id, pos;
+
+	if (0 == tagsz)
+		return(NULL);
+
+	x = artset_tagidx(s);
+
+	for (i = 0; i < x->qsz; i++)
+		if (x->qs[i]->tags == tags && 
+		    x->qs[i]->tagsz == tagsz &&
+		    x->qs[i]->asort == asort)
+			return(x->qs[i]);
+
+	if (NULL == x->ranks[asort]) {
+		perm = artset_order(s, asort);
+		x->ranks[asort] = xcalloc(s->artsz, sizeof(size_t));
+		for (i = 0; i < s->artsz; i++)
+			x->ranks[asort][perm[i]] = i;
+	}
+
+	q = xcalloc(1, sizeof(struct tagq));
+	q->asort = asort;
+	q->tags = tags;
+	q->tagsz = tagsz;
+	q->sz = s->artsz;
+	q->bits = xcalloc(s->artsz / 64 + 1, sizeof(uint64_t));
+
+	for (i = 0; i < tagsz; i++) {
+		if (STRMAP_NONE == (id = strmap_get(x->map, tags[i])))
+			continue;
+		for (j = x->postoffs[id]; j < x->postoffs[id + 1]; j++) {
+			pos = x->ranks[asort][x->posts[j]];
+			q->bits[pos / 64] |= (uint64_t)1 << (pos % 64);
+		}
+	}
+
+	x->qs = xreallocarray(x->qs, x->qsz + 1, sizeof(struct tagq *));
+	x->qs[x->qsz++] = q;
+	return(q);
+}
+
+/*
+ * Index of the lowest set bit of "v", which must be non-zero.
+ */
+static size_t
+bitctz(uint64_t v)
+{
+#if defined(__GNUC__)
+	return(__builtin_ctzll(v));
+#else
+	size_t	 n = 0;
+
+	for ( ; 0 == (v & 1); v >>= 1)
+		n++;
+	return(n);
+#endif
+}
+
+/*
+ * Number of set bits of "v".
+ */
+static size_t
+bitcount(uint64_t v)
+{
+#if defined(__GNUC__)
+	return(__builtin_popcountll(v));
+#else
+	size_t	 n = 0;
+
+	for ( ; 0 != v; v &= v - 1)
+		n++;
+	return(n);
+#endif
+}
+
+/*
+ * Return the first position at or after "pos" in "q", or the number of
+ * articles if there are none.
+ * If "q" is NULL, all positions match.
+ */
+size_t
+tagq_next(const struct tagq *q, size_t pos)
+{
+	size_t		 w;
+	uint64_t	 v;
+
+	if (NULL == q)
+		return(pos);
+	if (pos >= q->sz)
+		return(q->sz);
+
+	w = pos / 64;
+	v = q->bits[w] & (~(uint64_t)0 << (pos % 64));
+	while (0 == v) {
+		if (++w > q->sz / 64)
+			return(q->sz);
+		v = q->bits[w];
+	}
+
+	pos = w * 64 + bitctz(v);
+	return(pos < q->sz ? pos : q->sz);
+}
+
+/*
+ * Return the position of the "n"th (from zero) match in "q", or the
+ * number of articles if there are not so many.
+ * If "q" is NULL, all positions match.
+ */
+size_t
+tagq_nth(const struct tagq *q, size_t n)
+{
+	size_t		 w, c;
+	uint64_t	 v;
+
+	if (NULL == q)
+		return(n);
+
+	for (w = 0; w <= q->sz / 64; w++) {
+		v = q->bits[w];
+		c = bitcount(v);
+		if (n >= c) {
+			n -= c;
+			continue;
+		}
+		while (n-- > 0)
+			v &= v - 1;
+		return(w * 64 + bitctz(v));
+	}
+
+	return(q->sz);
+}
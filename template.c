@@ -0,0 +1,773 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2013--2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <assert.h>
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <expat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+enum	tmplopt {
+	TMPLOP_TEXT, /* literal text */
+	TMPLOP_TEXTX, /* text with ${sblg-xxx} substitution */
+	TMPLOP_ARTICLE, /* <article data-sblg-article> */
+	TMPLOP_NAV /* <nav data-sblg-nav> */
+};
+
+/*
+ * Parameters of a <nav data-sblg-nav> block.
+ * The size and start depend on the number of articles, so we keep
+ * them as given and clamp them when run.
+ */
+struct	tmplnav {
+	int		  sz; /* data-sblg-navsz */
+	int		  szset; /* whether sz is set */
+	int		  start; /* data-sblg-navstart */
+	int		  startset; /* whether start is set */
+	int		  use; /* use navigation contents */
+	int		  xml; /* don't print html elements */
+	int		  usesort; /* whether to use sort */
+	enum asort	  sort; /* override sort order */
+};
+
+struct	tmplop {
+	enum tmplopt	  type;
+	char		 *str; /* text or nav contents (or NULL) */
+	size_t		  strsz; /* length of str */
+	struct xmltok	 *toks; /* tokens of textx or nav contents */
+	size_t		  toksz; /* number of toks */
+	char		**tags; /* article or nav tags to match */
+	size_t		  tagsz; /* number of tags */
+	int		  permlink; /* article: show permanent link */
+	struct tmplnav	  nav; /* nav: parameters */
+};
+
+/*
+ * A template compiled into a sequence of operations.
+ * Running these produces the same output as running the original
+ * handlers over the template, but without re-parsing it each time.
+ */
+struct	tmpl {
+	struct tmplop	 *ops; /* operations */
+	size_t		  opsz; /* number of ops */
+	struct arena	 *arena; /* strings of ops */
+	char		 *cont; /* leading text if continuing */
+	size_t		  contop; /* first op if continuing */
+};
+
+struct	tparse {
+	XML_Parser	  p;
+	enum tmplmode	  mode; /* how we handle elements */
+	struct tmpl	 *t; /* template being built */
+	size_t		  stack; /* temporary: tag stack size */
+	struct sbuf	  text; /* pending literal text */
+	struct sbuf	  buf; /* pending text to substitute */
+	struct sbuf	  nav; /* temporary: nav contents */
+	struct tmplnav	  navp; /* temporary: nav parameters */
+	char		**navtags; /* temporary: nav tags */
+	size_t		  navtagsz; /* temporary: number of navtags */
+};
+
+static	void	tp_begin(void *, const XML_Char *, const XML_Char **);
+static	void	tp_end(void *, const XML_Char *);
+static	void	tp_text(void *, const XML_Char *, int);
+
+/*
+ * Append an operation of the given type, with a copy of "b" (if not
+ * NULL or empty) as its string.
+ * Returns a pointer valid until the next append.
+ */
+static struct tmplop *
+tp_op(struct tparse *tp, enum tmplopt type, const struct sbuf *b)
+{
+	struct tmpl	*t = tp->t;
+	struct tmplop	*op;
+
+	t->ops = xreallocarray(t->ops, t->opsz + 1, sizeof(struct tmplop));
+	op = &t->ops[t->opsz++];
+	memset(op, 0, sizeof(struct tmplop));
+	op->type = type;
+
+	if (NULL != b && b->sz > 0) {
+		op->str = arena_strndup(t->arena, b->p, b->sz);
+		op->strsz = b->sz;
+	}
+
+	/* Placeholders are only looked up once. */
+
+	if (TMPLOP_TEXTX == type || TMPLOP_NAV == type)
+		xmltok(op->str, &op->toks, &op->toksz);
+
+	return(op);
+}
+
+/*
+ * Flush pending literal text into a single operation.
+ */
+static void
+tp_flushtext(struct tparse *tp)
+{
+
+	if (0 == tp->text.sz)
+		return;
+	tp_op(tp, TMPLOP_TEXT, &tp->text);
+	sbuf_reset(&tp->text);
+}
+
+/*
+ * Flush pending substituted text.
+ * This must not be merged with any other text: placeholders don't
+ * span the element boundaries that flush us.
+ */
+static void
+tp_flushbuf(struct tparse *tp)
+{
+
+	if (0 == tp->buf.sz)
+		return;
+	tp_flushtext(tp);
+	tp_op(tp, TMPLOP_TEXTX, &tp->buf);
+	sbuf_reset(&tp->buf);
+}
+
+/*
+ * Like xmlopens(), but appending to the pending literal text.
+ */
+static void
+tp_opens(struct tparse *tp, const XML_Char *s, const XML_Char **atts)
+{
+
+	sbuf_putc(&tp->text, '<');
+	sbuf_puts(&tp->text, s);
+	for ( ; NULL != *atts; atts += 2) {
+		sbuf_putc(&tp->text, ' ');
+		sbuf_puts(&tp->text, atts[0]);
+		sbuf_append(&tp->text, "=\"", 2);
+		xmlstrescape(&tp->text, atts[1]);
+		sbuf_putc(&tp->text, '"');
+	}
+	if (xmlvoid(s))
+		sbuf_append(&tp->text, " /", 2);
+	sbuf_putc(&tp->text, '>');
+}
+
+/*
+ * Like xmlopensx(): attribute values are substituted, not escaped.
+ */
+static void
+tp_opensx(struct tparse *tp, const XML_Char *s, const XML_Char **atts)
+{
+
+	sbuf_putc(&tp->text, '<');
+	sbuf_puts(&tp->text, s);
+	for ( ; NULL != *atts; atts += 2) {
+		sbuf_putc(&tp->text, ' ');
+		sbuf_puts(&tp->text, atts[0]);
+		sbuf_append(&tp->text, "=\"", 2);
+		sbuf_puts(&tp->buf, atts[1]);
+		tp_flushbuf(tp);
+		sbuf_putc(&tp->text, '"');
+	}
+	if (xmlvoid(s))
+		sbuf_append(&tp->text, " /", 2);
+	sbuf_putc(&tp->text, '>');
+}
+
+static void
+tp_text(void *dat, const XML_Char *s, int len)
+{
+	struct tparse	*tp = dat;
+
+	if (TMPL_LINKALL == tp->mode)
+		xmlstrtext(&tp->text, s, len);
+	else
+		xmlstrtext(&tp->buf, s, len);
+}
+
+static void
+tp_end(void *dat, const XML_Char *s)
+{
+	struct tparse	*tp = dat;
+
+	tp_flushbuf(tp);
+	xmlstrclose(&tp->text, s);
+}
+
+static void
+tp_article_begin(void *dat, const XML_Char *s, const XML_Char **atts)
+{
+	struct tparse	*tp = dat;
+
+	tp->stack += 0 == strcasecmp(s, "article");
+}
+
+/*
+ * At the close of an <article data-sblg-article>, resume.
+ * In compile mode, we stop looking at elements altogether and pass
+ * the remainder of the template through as text.
+ */
+static void
+tp_article_end(void *dat, const XML_Char *s)
+{
+	struct tparse	*tp = dat;
+
+	if (strcasecmp(s, "article") || 0 != --tp->stack)
+		return;
+
+	if (TMPL_COMPILE == tp->mode)
+		XML_SetElementHandler(tp->p, NULL, NULL);
+	else
+		XML_SetElementHandler(tp->p, tp_begin, tp_end);
+	XML_SetDefaultHandlerExpand(tp->p, tp_text);
+}
+
+static void
+tp_nav_text(void *dat, const XML_Char *s, int len)
+{
+	struct tparse	*tp = dat;
+
+	xmlstrtext(&tp->nav, s, len);
+}
+
+static void
+tp_nav_begin(void *dat, const XML_Char *s, const XML_Char **atts)
+{
+	struct tparse	*tp = dat;
+
+	tp->stack += 0 == strcasecmp(s, "nav");
+	xmlstropen(&tp->nav, s, atts);
+}
+
+static void
+tp_nav_end(void *dat, const XML_Char *s)
+{
+	struct tparse	*tp = dat;
+	struct tmplop	*op;
+
+	if (strcasecmp(s, "nav") || 0 != --tp->stack) {
+		xmlstrclose(&tp->nav, s);
+		return;
+	}
+
+	XML_SetElementHandler(tp->p, tp_begin, tp_end);
+	XML_SetDefaultHandlerExpand(tp->p, tp_text);
+
+	tp_flushtext(tp);
+	op = tp_op(tp, TMPLOP_NAV, &tp->nav);
+	op->nav = tp->navp;
+	op->tags = tp->navtags;
+	op->tagsz = tp->navtagsz;
+	tp->navtags = NULL;
+	tp->navtagsz = 0;
+	sbuf_reset(&tp->nav);
+
+	if ( ! op->nav.xml)
+		xmlstrclose(&tp->text, s);
+}
+
+/*
+ * Begin a <nav data-sblg-nav> block, recording its parameters.
+ */
+static void
+tp_nav(struct tparse *tp, const XML_Char *s, const XML_Char **atts)
+{
+	const XML_Char	**attp;
+	const XML_Char	 *sort = NULL;
+	struct tmplnav	 *nav = &tp->navp;
+
+	memset(nav, 0, sizeof(struct tmplnav));
+	nav->sort = ASORT_DATE;
+
+	for (attp = atts; NULL != *attp; attp += 2) {
+		if (0 == strcasecmp(attp[0], "data-sblg-navsz")) {
+			nav->sz = atoi(attp[1]);
+			nav->szset = 1;
+		} else if (0 == strcasecmp(attp[0],
+				"data-sblg-navstart")) {
+			nav->start = atoi(attp[1]);
+			nav->startset = 1;
+		} else if (0 == strcasecmp(attp[0],
+				"data-sblg-navcontent")) {
+			nav->use = xmlbool(attp[1]);
+		} else if (0 == strcasecmp(attp[0],
+				"data-sblg-navxml")) {
+			nav->xml = xmlbool(attp[1]);
+		} else if (0 == strcasecmp(attp[0],
+				"data-sblg-navtag")) {
+			hashtag(tp->t->arena, &tp->navtags,
+				&tp->navtagsz, attp[1]);
+		} else if (0 == strcasecmp(attp[0],
+				"data-sblg-navsort")) {
+			sort = attp[1];
+		}
+	}
+
+	/* Are we overriding the sort order? */
+
+	if (NULL != sort) {
+		nav->usesort = 1;
+		if (0 == strcasecmp(sort, "date"))
+			nav->sort = ASORT_DATE;
+		else if (0 == strcasecmp(sort, "rdate"))
+			nav->sort = ASORT_RDATE;
+		else if (0 == strcasecmp(sort, "filename"))
+			nav->sort = ASORT_FILENAME;
+		else if (0 == strcasecmp(sort, "cmdline"))
+			nav->sort = ASORT_CMDLINE;
+		else
+			nav->usesort = 0;
+	}
+
+	if ( ! nav->xml)
+		tp_opens(tp, s, atts);
+
+	tp->stack++;
+	XML_SetElementHandler(tp->p, tp_nav_begin, tp_nav_end);
+	XML_SetDefaultHandlerExpand(tp->p, tp_nav_text);
+}
+
+/*
+ * Begin an <article data-sblg-article> slot.
+ * Its children are thrown away.
+ */
+static void
+tp_article(struct tparse *tp, const XML_Char **atts)
+{
+	const XML_Char	**attp;
+	struct tmplop	 *op;
+	char		 *str, *tok, *tfr;
+
+	tp_flushtext(tp);
+	op = tp_op(tp, TMPLOP_ARTICLE, NULL);
+
+	/*
+	 * See if we should only output certain tags.
+	 * This attribute may happen multiple times.
+	 * (Compile mode only ever shows its one article.)
+	 */
+
+	for (attp = atts; NULL != *attp; attp += 2) {
+		if (TMPL_COMPILE == tp->mode)
+			break;
+		if (strcasecmp(*attp, "data-sblg-articletag"))
+			continue;
+		tfr = str = xstrdup(attp[1]);
+		while (NULL != (tok = strsep(&str, " \t"))) {
+			op->tags = xreallocarray(op->tags,
+				op->tagsz + 1, sizeof(char *));
+			op->tags[op->tagsz++] =
+				arena_strdup(tp->t->arena, tok);
+		}
+		free(tfr);
+	}
+
+	if (TMPL_COMPILE != tp->mode) {
+		for (attp = atts; NULL != *attp; attp += 2)
+			if (0 == strcasecmp(*attp, "data-sblg-permlink"))
+				break;
+		op->permlink = NULL == *attp || xmlbool(attp[1]);
+	}
+
+	tp->stack++;
+	XML_SetDefaultHandlerExpand(tp->p, NULL);
+	XML_SetElementHandler(tp->p, tp_article_begin, tp_article_end);
+}
+
+/*
+ * Look for important tags in the template.
+ * Only -C, -L, and -P (and compile mode) substitute into attributes of
+ * regular elements.
+ */
+static void
+tp_begin(void *dat, const XML_Char *s, const XML_Char **atts)
+{
+	struct tparse	 *tp = dat;
+	const XML_Char	**attp;
+
+	assert(0 == tp->stack);
+
+	tp_flushbuf(tp);
+
+	if (TMPL_COMPILE != tp->mode && 0 == strcasecmp(s, "nav")) {
+		for (attp = atts; NULL != *attp; attp += 2)
+			if (0 == strcasecmp(*attp, "data-sblg-nav"))
+				break;
+		if (NULL == *attp || ! xmlbool(attp[1]))
+			tp_opens(tp, s, atts);
+		else
+			tp_nav(tp, s, atts);
+		return;
+	} else if (strcasecmp(s, "article")) {
+		if (TMPL_LINKALL == tp->mode)
+			tp_opens(tp, s, atts);
+		else
+			tp_opensx(tp, s, atts);
+		return;
+	}
+
+	for (attp = atts; NULL != *attp; attp += 2)
+		if (0 == strcasecmp(*attp, "data-sblg-article"))
+			break;
+
+	if (NULL != *attp && xmlbool(attp[1]))
+		tp_article(tp, atts);
+	else if (TMPL_COMPILE == tp->mode)
+		tp_opensx(tp, s, atts);
+	else
+		tp_opens(tp, s, atts);
+}
+
+/*
+ * Parse the template file "templ" into a program for tmpl_exec().
+ * The "mode" governs how elements are handled, matching the
+ * historical behaviour of each output mode.
+ * Returns NULL on failure.
+ */
+struct tmpl *
+tmpl_compile(XML_Parser p, const char *templ, enum tmplmode mode)
+{
+	struct tparse	 tp;
+	struct tmpl	*t;
+	struct input	 in;
+	int		 c, rc = 0;
+
+	memset(&tp, 0, sizeof(struct tparse));
+
+	t = xcalloc(1, sizeof(struct tmpl));
+	t->arena = arena_alloc();
+
+	if ( ! input_open(&in, templ))
+		goto out;
+
+	tp.p = p;
+	tp.mode = mode;
+	tp.t = t;
+
+	XML_ParserReset(p, NULL);
+	XML_SetElementHandler(p, tp_begin, tp_end);
+	XML_SetDefaultHandlerExpand(p, tp_text);
+	XML_SetUserData(p, &tp);
+
+	if ((c = input_parse(&in, p)) <= 0) {
+		if (0 == c)
+			warnx("%s:%zu:%zu: %s", templ,
+				XML_GetCurrentLineNumber(p),
+				XML_GetCurrentColumnNumber(p),
+				XML_ErrorString(XML_GetErrorCode(p)));
+		goto out;
+	}
+
+	/*
+	 * Only compile mode has ever printed trailing text.
+	 * When linkall_r() re-ran the template for each output, this
+	 * text was instead prepended to the next output's leading text,
+	 * so remember that as well.
+	 * Pages print it as the blog amalgamation does.
+	 */
+
+	if (TMPL_COMPILE == mode || TMPL_INDEX == mode)
+		tp_flushbuf(&tp);
+	else if (TMPL_LINKALL_SINGLE == mode && tp.buf.sz > 0) {
+		if (t->opsz > 0 && TMPLOP_TEXTX == t->ops[0].type) {
+			sbuf_append(&tp.buf, 
+				t->ops[0].str, t->ops[0].strsz);
+			t->contop = 1;
+		}
+		t->cont = arena_strndup(t->arena, tp.buf.p, tp.buf.sz);
+	}
+	tp_flushtext(&tp);
+	rc = 1;
+out:
+	input_close(&in);
+	sbuf_free(&tp.text);
+	sbuf_free(&tp.buf);
+	sbuf_free(&tp.nav);
+	free(tp.navtags);
+	if (rc)
+		return(t);
+	tmpl_free(t);
+	return(NULL);
+}
+
+/*
+ * The number of article slots, so the most article bodies shown by a
+ * single output.
+ * If zero, articles may be parsed for metadata alone.
+ */
+size_t
+tmpl_slots(const struct tmpl *t)
+{
+	size_t	 i, n = 0;
+
+	for (i = 0; i < t->opsz; i++)
+		n += TMPLOP_ARTICLE == t->ops[i].type;
+
+	return(n);
+}
+
+/*
+ * Compute the orderings and tag queries of "set" that tmpl_exec() will
+ * use for "t" in order "asort".
+ * After this, tmpl_exec() may be run concurrently over a shared set
+ * (see artset_share()).
+ */
+void
+tmpl_prepare(const struct tmpl *t, struct artset *set, enum asort asort)
+{
+	const struct tmplop *op;
+	enum asort	 sort;
+	size_t		 i;
+
+	artset_order(set, asort);
+
+	for (i = 0; i < t->opsz; i++) {
+		op = &t->ops[i];
+		if (TMPLOP_ARTICLE == op->type)
+			sort = asort;
+		else if (TMPLOP_NAV == op->type)
+			sort = op->nav.usesort ? op->nav.sort : asort;
+		else
+			continue;
+		artset_order(set, sort);
+		artset_tagq(set, sort, op->tags, op->tagsz);
+	}
+}
+
+void
+tmpl_free(struct tmpl *t)
+{
+	size_t	 i;
+
+	if (NULL == t)
+		return;
+	for (i = 0; i < t->opsz; i++) {
+		free(t->ops[i].tags);
+		free(t->ops[i].toks);
+	}
+	free(t->ops);
+	arena_free(t->arena);
+	free(t);
+}
+
+/*
+ * Show the next article at or after "spos" (and before "ssposz")
+ * matching the slot's tags "q".
+ */
+static void
+tmpl_article(struct out *f, const struct tmplop *op, const char *dst,
+	struct artset *set, const size_t *perm, 
+	const struct tagq *q, size_t *spos, size_t ssposz,
+	const struct page *pg)
+{
+	const struct article *art;
+
+	*spos = tagq_next(q, *spos);
+
+	/* We have no articles left to show. */
+
+	if (*spos >= ssposz)
+		return;
+
+	/* Echo the formatted text of the article. */
+
+	art = &set->arts[perm[*spos]];
+	xmltextx(f, artset_body(set, perm[*spos]), 
+		dst, set, perm, *spos, pg);
+	(*spos)++;
+
+	if ( ! op->permlink)
+		return;
+
+	xmlopen(f, "div", "data-sblg-permlink", "1", NULL);
+	xmlopen(f, "a", "href", art->src, NULL);
+	out_puts(f, "permanent link");
+	xmlclose(f, "a");
+	xmlclose(f, "div");
+	out_putc(f, '\n');
+}
+
+/*
+ * Return where the article slots of "t" would leave off if filled from
+ * position "first" of the ordering "asort" of "set" by tmpl_exec(),
+ * setting "shown" to the number of articles they'd show.
+ * The next page of a paginated output starts here.
+ */
+size_t
+tmpl_page(const struct tmpl *t, struct artset *set, 
+	enum asort asort, size_t first, size_t *shown)
+{
+	const struct tmplop *op;
+	size_t		 i, spos = first;
+
+	*shown = 0;
+	for (i = 0; i < t->opsz && spos < set->artsz; i++) {
+		op = &t->ops[i];
+		if (TMPLOP_ARTICLE != op->type)
+			continue;
+		spos = tagq_next(artset_tagq(set, 
+			asort, op->tags, op->tagsz), spos);
+		if (spos >= set->artsz)
+			break;
+		spos++;
+		(*shown)++;
+	}
+
+	return(spos < set->artsz ? spos : set->artsz);
+}
+
+static void
+tmpl_nav(struct out *f, const struct tmplop *op, const char *dst,
+	struct artset *set, enum asort asort, const size_t *perm,
+	const struct page *pg)
+{
+	const struct tmplnav *nav = &op->nav;
+	const struct article *arts = set->arts, *art;
+	const struct tagq *q;
+	size_t		 i, k, navlen, navstart, artsz = set->artsz;
+
+	/* Only open the <ul> if we're printing HTML content. */
+
+	if ( ! nav->xml) {
+		out_putc(f, '\n');
+		xmlopen(f, "ul", NULL);
+		out_putc(f, '\n');
+	}
+
+	/*
+	 * Take the number of elements to show to be the min of
+	 * the full count or as user-specified.
+	 */
+
+	navlen = artsz;
+	if (nav->szset) {
+		navlen = nav->sz;
+		if (navlen > artsz)
+			navlen = artsz;
+	}
+
+	navstart = 0;
+	if (nav->startset) {
+		navstart = nav->start;
+		if (navstart > artsz)
+			navstart = artsz;
+		if (navstart)
+			navstart--;
+	}
+
+	if (nav->usesort) {
+		asort = nav->sort;
+		perm = artset_order(set, asort);
+	}
+
+	q = artset_tagq(set, asort, op->tags, op->tagsz);
+
+	/*
+	 * Start at the article we want to start printing.
+	 * This accounts for the starting article to show; which, due to
+	 * tagging, might not be a true offset.
+	 */
+	k = tagq_nth(q, navstart);
+
+	/*
+	 * Show matching articles from the first one, above.
+	 * If we haven't been provided a navigation template (i.e., what
+	 * was within the navigation tags), then make a simple default
+	 * consisting of a list entry.
+	 */
+	for (i = 0; k < artsz; k = tagq_next(q, k + 1)) {
+		art = &arts[perm[k]];
+		if (nav->xml) {
+			xmltoksx(f, op->toks, op->toksz, 
+				dst, set, perm, k, pg);
+		} else if ( ! nav->use || 0 == op->strsz) {
+			xmlopen(f, "li", NULL);
+			out_puts(f, artset_date(set, perm[k])->localdate);
+			out_puts(f, ": ");
+			xmlopen(f, "a", "href", art->src, NULL);
+			if (NULL != art->titletext)
+				out_puts(f, art->titletext);
+			xmlclose(f, "a");
+			xmlclose(f, "li");
+			out_putc(f, '\n');
+		} else {
+			xmlopen(f, "li", NULL);
+			xmltoksx(f, op->toks, op->toksz, 
+				dst, set, perm, k, pg);
+			xmlclose(f, "li");
+		}
+		if (++i >= navlen)
+			break;
+	}
+
+	if ( ! nav->xml)
+		xmlclose(f, "ul");
+}
+
+/*
+ * Run the compiled template "t" into "f", whose name is "dst" (or NULL
+ * if standard output).
+ * Articles in "set" are available to navigation, and those in
+ * [first, last) of the ordering "asort" fill the article slots.
+ * Substitutions refer to the article "first".
+ * If "cont" is set, this output follows another from the same template
+ * (see tmpl_compile()).
+ * If "pg" is not NULL, this output is that page of several.
+ */
+void
+tmpl_exec(const struct tmpl *t, struct out *f, const char *dst,
+	struct artset *set, enum asort asort,
+	size_t first, size_t last, int cont, const struct page *pg)
+{
+	const struct tmplop *op;
+	const size_t	*perm;
+	size_t		 i = 0, spos = first;
+
+	perm = artset_order(set, asort);
+
+	if (cont && NULL != t->cont) {
+		xmltextx(f, t->cont, dst, set, perm, first, pg);
+		i = t->contop;
+	}
+
+	for ( ; i < t->opsz; i++) {
+		op = &t->ops[i];
+		switch (op->type) {
+		case (TMPLOP_TEXT):
+			out_write(f, op->str, op->strsz);
+			break;
+		case (TMPLOP_TEXTX):
+			xmltoksx(f, op->toks, op->toksz, 
+				dst, set, perm, first, pg);
+			break;
+		case (TMPLOP_ARTICLE):
+			tmpl_article(f, op, dst, set, perm,
+				artset_tagq(set, asort, op->tags, op->tagsz),
+				&spos, last, pg);
+			break;
+		case (TMPLOP_NAV):
+			tmpl_nav(f, op, dst, set, asort, perm, pg);
+			break;
+		}
+	}
+}
@@ -23,6 +23,7 @@
 #if HAVE_ERR
 # include <err.h>
 #endif
+#include <errno.h>
 #include <expat.h>
 #include <fcntl.h>
 #include <stdarg.h>
@@ -62,7 +63,7 @@ static	const char *elemvoid[] = {
  * itself out.
  * For example, <p> is not void; <link /> is.
  */
-static int
+int
 xmlvoid(const XML_Char *s)
 {
 	const char	**cp;
@@ -74,66 +75,6 @@ xmlvoid(const XML_Char *s)
 	return(0);
 }
 
-int
-cmdlinecmp(const void *p1, const void *p2)
-{
-	const struct article *s1 = p1, *s2 = p2;
-
-	return(s1->order - s2->order);
-}
-
-int
-filenamecmp(const void *p1, const void *p2)
-{
-	const struct article *s1 = p1, *s2 = p2;
-
-	if (s1->sort != s2->sort) {
-		if (SORT_FIRST == s1->sort || 
-		    SORT_LAST == s2->sort)
-			return(-1);
-		else if (SORT_LAST == s1->sort || 
-			 SORT_FIRST == s2->sort)
-			return(1);
-	}
-
-	return(strcmp(s1->src, s2->src));
-}
-
-int
-rdatecmp(const void *p1, const void *p2)
-{
-	const struct article *s1 = p1, *s2 = p2;
-
-	if (s1->sort != s2->sort) {
-		if (SORT_FIRST == s2->sort || 
-		    SORT_LAST == s1->sort)
-			return(-1);
-		else if (SORT_LAST == s2->sort || 
-			 SORT_FIRST == s1->sort)
-			return(1);
-	}
-
-	return(difftime(s1->time, s2->time));
-}
-
-int
-datecmp(const void *p1, const void *p2)
-{
-	const struct article *s1 = p1, *s2 = p2;
-
-	if (s1->sort != s2->sort) {
-		if (SORT_FIRST == s1->sort || 
-		    SORT_LAST == s2->sort)
-			return(-1);
-		else if (SORT_LAST == s1->sort || 
-			 SORT_FIRST == s2->sort)
-			return(1);
-	}
-
-	return(difftime(s2->time, s1->time));
-}
-
-
 /*
  * Map a regular file into memory for parsing.
  * Make sure it's not too large, first.
@@ -189,6 +130,196 @@ mmap_close(int fd, void *buf, size_t sz)
 		close(fd);
 }
 
+/*
+ * Open "f" for parsing, "-" being standard input.
+ * Regular files smaller than INPUT_MMAPMAX are mapped; anything else
+ * (pipes, large files, or a failed mapping) is read by input_parse().
+ * Release with input_close() whether or not this succeeds.
+ */
+int
+input_open(struct input *in, const char *f)
+{
+	struct stat	 st;
+
+	memset(in, 0, sizeof(struct input));
+	in->name = f;
+
+	if (0 == strcmp(f, "-"))
+		in->fd = STDIN_FILENO;
+	else if (-1 == (in->fd = open(f, O_RDONLY, 0))) {
+		warn("%s", f);
+		return(0);
+	}
+
+	if (-1 == fstat(in->fd, &st)) {
+		warn("%s", f);
+		return(0);
+	} else if (S_ISDIR(st.st_mode)) {
+		warnx("%s: is a directory", f);
+		return(0);
+	}
+
+	if ( ! S_ISREG(st.st_mode) || 
+	    0 == st.st_size || st.st_size >= INPUT_MMAPMAX)
+		return(1);
+
+	in->map = mmap(NULL, (size_t)st.st_size, 
+		PROT_READ, MAP_FILE|MAP_SHARED, in->fd, 0);
+	if (MAP_FAILED == in->map)
+		in->map = NULL;
+	else
+		in->mapsz = (size_t)st.st_size;
+
+	return(1);
+}
+
+/*
+ * Parse all of "in" with "p", whose handlers have been set.
+ * Unmapped input is read into the parser's own buffer a chunk at a
+ * time, so memory stays bounded regardless of input size.
+ * Returns 1 on success, 0 on a parse error (which the caller reports
+ * as it sees fit), or -1 on a read error (reported here).
+ */
+int
+input_parse(struct input *in, XML_Parser p)
+{
+	void		*buf;
+	ssize_t		 ssz;
+
+	if (NULL != in->map)
+		return(XML_STATUS_OK == 
+			XML_Parse(p, in->map, (int)in->mapsz, 1));
+
+	for (;;) {
+		if (NULL == (buf = XML_GetBuffer(p, INPUT_CHUNK)))
+			return(0);
+		if (-1 == (ssz = read(in->fd, buf, INPUT_CHUNK))) {
+			if (EINTR == errno)
+				continue;
+			warn("%s", in->name);
+			return(-1);
+		}
+		if (XML_STATUS_OK != 
+		    XML_ParseBuffer(p, (int)ssz, 0 == ssz))
+			return(0);
+		if (0 == ssz)
+			return(1);
+	}
+}
+
+/*
+ * Reverse of input_open().
+ * Standard input is left open.
+ */
+void
+input_close(struct input *in)
+{
+
+	if (NULL != in->map)
+		munmap(in->map, in->mapsz);
+	if (-1 != in->fd && STDIN_FILENO != in->fd)
+		close(in->fd);
+	in->map = NULL;
+	in->fd = -1;
+}
+
+/*
+ * The output file name for the input "src": "src" with ".html" in place
+ * of a trailing ".xml", or with ".html" appended otherwise.
+ */
+char *
+outname(const char *src)
+{
+	const char	*cp;
+	char		*out;
+	size_t		 sz;
+
+	if (NULL == (cp = strrchr(src, '.')) || strcasecmp(cp + 1, "xml"))
+		cp = src + strlen(src);
+	sz = cp - src;
+
+	out = xmalloc(sz + 6);
+	memcpy(out, src, sz);
+	memcpy(out + sz, ".html", 6);
+	return(out);
+}
+
+/*
+ * The output file "name" within the directory "dir", disregarding any
+ * leading "/" of "name".
+ * See mkparents() for creating the directories on the way.
+ */
+char *
+outpath(const char *dir, const char *name)
+{
+	char	*out;
+	size_t	 dirsz, sz;
+
+	while ('/' == *name)
+		name++;
+
+	dirsz = strlen(dir);
+	sz = strlen(name);
+	out = xmalloc(dirsz + sz + 2);
+	memcpy(out, dir, dirsz);
+	out[dirsz] = '/';
+	memcpy(out + dirsz + 1, name, sz + 1);
+	return(out);
+}
+
+/*
+ * The output file of page "num" (from 1) of the paginated output "dst":
+ * "dst" itself for the first, else with the number before the suffix
+ * of its last component, so "blog.html" has "blog2.html" and so on.
+ */
+char *
+pagename(const char *dst, size_t num)
+{
+	const char	*cp, *sfx;
+	char		*out;
+	size_t		 sz, max;
+
+	if (num <= 1)
+		return(xstrdup(dst));
+
+	cp = strrchr(dst, '/');
+	cp = NULL == cp ? dst : cp + 1;
+	if (NULL == (sfx = strrchr(cp, '.')) || sfx == cp)
+		sfx = cp + strlen(cp);
+	sz = sfx - dst;
+	max = sz + strlen(sfx) + 24;
+
+	out = xmalloc(max);
+	memcpy(out, dst, sz);
+	snprintf(out + sz, max - sz, "%zu%s", num, sfx);
+	return(out);
+}
+
+/*
+ * Create the directories leading to the file "fn", as with mkdir -p.
+ * Returns zero on failure (having reported it).
+ */
+int
+mkparents(const char *fn)
+{
+	char	*path, *cp;
+	int	 rc = 1;
+
+	path = xstrdup(fn);
+
+	for (cp = path + 1; NULL != (cp = strchr(cp, '/')); *cp++ = '/') {
+		*cp = '\0';
+		if (-1 == mkdir(path, 0777) && EEXIST != errno) {
+			warn("%s", path);
+			rc = 0;
+			break;
+		}
+	}
+
+	free(path);
+	return(rc);
+}
+
 int
 xmlbool(const XML_Char *s)
 {
@@ -196,150 +327,153 @@ xmlbool(const XML_Char *s)
 	return(0 == strcasecmp(s, "1") || 0 == strcasecmp(s, "true"));
 }
 
+/*
+ * Make sure that "b" has room for "sz" more bytes and the terminating
+ * nil, growing it geometrically so that appends are amortised.
+ */
+static void
+sbuf_grow(struct sbuf *b, size_t sz)
+{
+	size_t	 max;
+
+	if (b->sz + sz < b->max)
+		return;
+
+	for (max = 0 == b->max ? 64 : b->max; b->sz + sz >= max; )
+		max *= 2;
+
+	b->p = xrealloc(b->p, max);
+	b->max = max;
+}
+
+/*
+ * Append "sz" bytes of "cp" to "b", keeping it nil-terminated.
+ */
 void
-xmlstrtext(char **p, size_t *sz, const XML_Char *s, int len)
+sbuf_append(struct sbuf *b, const char *cp, size_t sz)
 {
-	size_t		 ssz;
 
-	if (len > 0) {
-		ssz = *sz;
-		*sz += (size_t)len;
-		*p = xrealloc(*p, *sz + 1);
-		memcpy(*p + ssz, s, len);
-		(*p)[*sz] = '\0';
-	}
+	sbuf_grow(b, sz);
+	memcpy(b->p + b->sz, cp, sz);
+	b->sz += sz;
+	b->p[b->sz] = '\0';
 }
 
 void
-xmlstrflush(char *cp, size_t *sz)
+sbuf_puts(struct sbuf *b, const char *cp)
 {
 
-	if (0 == *sz)
-		return;
+	sbuf_append(b, cp, strlen(cp));
+}
 
-	*cp = '\0';
-	*sz = 0;
+void
+sbuf_putc(struct sbuf *b, char c)
+{
+
+	sbuf_grow(b, 1);
+	b->p[b->sz++] = c;
+	b->p[b->sz] = '\0';
 }
 
+/*
+ * Truncate "b" to the empty string, keeping its memory.
+ */
 void
-xmlstrclose(char **p, size_t *sz, const XML_Char *name)
+sbuf_reset(struct sbuf *b)
 {
-	size_t		 ssz;
 
-	if (xmlvoid(name))
-		return;
+	if (NULL != b->p)
+		b->p[0] = '\0';
+	b->sz = 0;
+}
+
+void
+sbuf_free(struct sbuf *b)
+{
 
-	ssz = strlen(name) + 3;
-	*sz += ssz;
-	*p = xrealloc(*p, *sz + 1);
-	strlcat(*p, "</", *sz + 1);
-	strlcat(*p, name, *sz + 1);
-	strlcat(*p, ">", *sz + 1);
+	free(b->p);
+	memset(b, 0, sizeof(struct sbuf));
 }
 
-static void
-xmlescape(FILE *f, const char *cp)
+void
+xmlstrtext(struct sbuf *b, const XML_Char *s, int len)
 {
 
-	for ( ; '\0' != *cp; cp++) 
-		switch (*cp) {
-		case ('"'):
-			fputs("&quot;", f);
-			break;
-		case ('&'):
-			fputs("&amp;", f);
-			break;
-		default:
-			fputc(*cp, f);
-			break;
-		}
+	if (len > 0)
+		sbuf_append(b, s, (size_t)len);
 }
 
-static size_t
-xmlstrescapesz(const char *cp)
+void
+xmlstrclose(struct sbuf *b, const XML_Char *name)
 {
-	size_t	sz;
 
-	for (sz = 0; '\0' != *cp; cp++) 
-		switch (*cp) {
-		case ('"'):
-			sz += strlen("&quot;");
-			break;
-		case ('&'):
-			sz += strlen("&amp;");
-			break;
-		default:
-			sz++;
-			break;
-		}
+	if (xmlvoid(name))
+		return;
 
-	return(sz);
+	sbuf_append(b, "</", 2);
+	sbuf_puts(b, name);
+	sbuf_putc(b, '>');
 }
 
 static void
-xmlstrescape(char *p, size_t sz, const char *cp)
+xmlescape(struct out *f, const char *cp)
 {
-	size_t	ssz;
+	size_t	 sz, n;
 
-	ssz = strlen(p);
-
-	for ( ; '\0' != *cp; cp++) 
-		switch (*cp) {
-		case ('"'):
-			ssz = strlcat(p, "&quot;", sz);
-			break;
-		case ('&'):
-			ssz = strlcat(p, "&amp;", sz);
+	for (sz = strlen(cp); sz > 0; cp++, sz--) {
+		n = escspan(cp, sz, "\"&");
+		out_write(f, cp, n);
+		if (0 == (sz -= n))
 			break;
-		default:
-			p[ssz++] = *cp;
-			p[ssz] = '\0';
+		cp += n;
+		if ('"' == *cp)
+			out_write(f, "&quot;", 6);
+		else
+			out_write(f, "&amp;", 5);
+	}
+}
+
+/*
+ * Like xmlescape(), but appending to "b".
+ * Unescaped runs are copied in one go.
+ */
+void
+xmlstrescape(struct sbuf *b, const char *cp)
+{
+	size_t	 sz, n;
+
+	for (sz = strlen(cp); sz > 0; cp++, sz--) {
+		n = escspan(cp, sz, "\"&");
+		sbuf_append(b, cp, n);
+		if (0 == (sz -= n))
 			break;
-		}
+		cp += n;
+		if ('"' == *cp)
+			sbuf_append(b, "&quot;", 6);
+		else
+			sbuf_append(b, "&amp;", 5);
+	}
 }
 
 void
-xmlstropen(char **p, size_t *sz, 
+xmlstropen(struct sbuf *b, 
 	const XML_Char *name, const XML_Char **atts)
 {
-	size_t		 ssz;
-	int		 isvoid;
-
-	isvoid = xmlvoid(name);
 
-	ssz = strlen(name) + 2 + isvoid;
-	*sz += ssz;
-	/* Make sure we zero the initial buffer. */
-	if (NULL == *p)
-		*p = xcalloc(*sz + 1, 1);
-	else 
-		*p = xrealloc(*p, *sz + 1);
-	strlcat(*p, "<", *sz + 1);
-	strlcat(*p, name, *sz + 1);
+	sbuf_putc(b, '<');
+	sbuf_puts(b, name);
 
 	for ( ; NULL != *atts; atts += 2) {
-		ssz = strlen(atts[0]) + 2;
-		*sz += ssz;
-		*p = xrealloc(*p, *sz + 1);
-		strlcat(*p, " ", *sz + 1);
-		strlcat(*p, atts[0], *sz + 1);
-		strlcat(*p, "=", *sz + 1);
-		/* 
-		 * Remember to buffer in '&quot;' space. 
-		 * Use enough as if each word were that.
-		 * FIXME: this is totally unnecessary.
-		 */
-		ssz = xmlstrescapesz(atts[1]) + 2;
-		*sz += ssz;
-		*p = xrealloc(*p, *sz + 1);
-		strlcat(*p, "\"", *sz + 1);
-		xmlstrescape(*p, *sz + 1, atts[1]);
-		strlcat(*p, "\"", *sz + 1);
+		sbuf_putc(b, ' ');
+		sbuf_puts(b, atts[0]);
+		sbuf_append(b, "=\"", 2);
+		xmlstrescape(b, atts[1]);
+		sbuf_putc(b, '"');
 	}
 
-	if (isvoid)
-		strlcat(*p, "/", *sz + 1);
-	strlcat(*p, ">", *sz + 1);
+	if (xmlvoid(name))
+		sbuf_putc(b, '/');
+	sbuf_putc(b, '>');
 }
 
 /*
@@ -347,11 +481,14 @@ xmlstropen(char **p, size_t *sz,
  * See xmlopen().
  */
 void
-xmlclose(FILE *f, const XML_Char *name)
+xmlclose(struct out *f, const XML_Char *name)
 {
 
-	if ( ! xmlvoid(name))
-		fprintf(f, "</%s>", name);
+	if ( ! xmlvoid(name)) {
+		out_write(f, "</", 2);
+		out_puts(f, name);
+		out_putc(f, '>');
+	}
 }
 
 /*
@@ -361,51 +498,28 @@ xmlclose(FILE *f, const XML_Char *name)
  * See xmlclose().
  */
 void
-xmlopen(FILE *f, const XML_Char *name, ...)
+xmlopen(struct out *f, const XML_Char *name, ...)
 {
 	va_list	 	 ap;
 	const XML_Char	*attr;
 
-	fputc('<', f);
-	fputs(name, f);
+	out_putc(f, '<');
+	out_puts(f, name);
 
 	va_start(ap, name);
 	while (NULL != (attr = va_arg(ap, XML_Char *))) {
-		fputc(' ', f);
-		fputs(attr, f);
-		fputs("=\"", f);
+		out_putc(f, ' ');
+		out_puts(f, attr);
+		out_puts(f, "=\"");
 		xmlescape(f, va_arg(ap, XML_Char *));
-		fputc('"', f);
+		out_putc(f, '"');
 	}
 	va_end(ap);
 
 	if (xmlvoid(name)) 
-		fputs(" /", f);
-
-	fputc('>', f);
-}
-
-/*
- * Format an article's localtime.
- * We accept "auto" or a string that's pumped into strftime(3).
- * If "auto", this determines which to use based upon we were given both
- * a date and a time.
- * The result is meant to be human-readable.
- */
-static void
-fmttime(char *buf, size_t bufsz, const char *arg, 
-	size_t argsz, int isdatetime, struct tm *tm)
-{
-	char	*fmt;
-
-	if (0 == argsz || 
-	    (4 == argsz && 0 == strncmp(arg, "auto", argsz))) 
-		fmt = xstrdup(isdatetime ? "%c" : "%x");
-	else
-		fmt = xstrndup(arg, argsz);
+		out_puts(f, " /");
 
-	strftime(buf, bufsz, fmt, tm);
-	free(fmt);
+	out_putc(f, '>');
 }
 
 /*
@@ -417,9 +531,9 @@ fmttime(char *buf, size_t bufsz, const char *arg,
  * matching case-sensitive prefix are printed.
  */
 static void
-taglist(FILE *f, const struct article *art, const char *arg, size_t argsz)
+taglist(struct out *f, const struct article *art, const char *arg, size_t argsz)
 {
-	size_t	 	 i, sz, found;
+	size_t	 	 i, sz, n, found;
 	const char	*cp;
 
 	for (found = i = 0; i < art->tagmapsz; i++) {
@@ -429,202 +543,368 @@ taglist(FILE *f, const struct article *art, const char *arg, size_t argsz)
 			    strncmp(arg, art->tagmap[i], argsz)) 
 				continue;
 		}
-		fputs("<span class=\"sblg-tag\">", f);
-		for (cp = art->tagmap[i] + argsz; '\0' != *cp; cp++) {
-			if ('\\' == cp[0] && ' ' == cp[1])
-				continue;
+		out_puts(f, "<span class=\"sblg-tag\">");
+		cp = art->tagmap[i] + argsz;
+		for (sz = strlen(cp); sz > 0; cp++, sz--) {
+			n = escspan(cp, sz, "<>\"&\\");
+			out_write(f, cp, n);
+			if (0 == (sz -= n))
+				break;
+			cp += n;
 			if ('<' == *cp)
-				fputs("&lt;", f);
+				out_write(f, "&lt;", 4);
 			else if ('>' == *cp)
-				fputs("&gt;", f);
+				out_write(f, "&gt;", 4);
 			else if ('"' == *cp)
-				fputs("&quot;", f);
+				out_write(f, "&quot;", 6);
 			else if ('&' == *cp)
-				fputs("&amp;", f);
-			else
-				fputc(*cp, f);
+				out_write(f, "&amp;", 5);
+			else if (' ' != cp[1])
+				out_putc(f, '\\');
 		}
-		fputs("</span>", f);
+		out_puts(f, "</span>");
 		found = 1;
 	}
 	if (0 == found)
-		fputs("<span class=\"sblg-tags-notfound\"></span>", f);
+		out_puts(f, "<span class=\"sblg-tags-notfound\"></span>");
 }
 
 /*
- * Given the nil-terminated string "s", emit all of its characters to
- * "f" while substituting ${sblg-xxxxx} tags in the process.
- * This uses the current array of articles "arts" length "artsz",
- * currently at position "artpos".
- * The "url" is the current file being written (naming "f").
- * FIXME: the contents written are not escaped in any way.
+ * Names of all ${sblg-xxx} placeholders, sorted for bsearch(3).
+ */
+static	const struct xmlkey {
+	const char	*name;
+	enum xmltokt	 type;
+} xmlkeys[] = {
+	{ "sblg-aside", XMLTOK_ASIDE },
+	{ "sblg-asidetext", XMLTOK_ASIDETEXT },
+	{ "sblg-author", XMLTOK_AUTHOR },
+	{ "sblg-authortext", XMLTOK_AUTHORTEXT },
+	{ "sblg-base", XMLTOK_BASE },
+	{ "sblg-date", XMLTOK_DATE },
+	{ "sblg-datetime", XMLTOK_DATETIME },
+	{ "sblg-datetime-fmt", XMLTOK_DATETIME_FMT },
+	{ "sblg-first-base", XMLTOK_FIRST_BASE },
+	{ "sblg-first-stripbase", XMLTOK_FIRST_STRIPBASE },
+	{ "sblg-first-striplangbase", XMLTOK_FIRST_STRIPLANGBASE },
+	{ "sblg-get", XMLTOK_GET },
+	{ "sblg-img", XMLTOK_IMG },
+	{ "sblg-last-base", XMLTOK_LAST_BASE },
+	{ "sblg-last-stripbase", XMLTOK_LAST_STRIPBASE },
+	{ "sblg-last-striplangbase", XMLTOK_LAST_STRIPLANGBASE },
+	{ "sblg-next-base", XMLTOK_NEXT_BASE },
+	{ "sblg-next-stripbase", XMLTOK_NEXT_STRIPBASE },
+	{ "sblg-next-striplangbase", XMLTOK_NEXT_STRIPLANGBASE },
+	{ "sblg-page", XMLTOK_PAGE },
+	{ "sblg-page-next", XMLTOK_PAGE_NEXT },
+	{ "sblg-page-prev", XMLTOK_PAGE_PREV },
+	{ "sblg-pages", XMLTOK_PAGES },
+	{ "sblg-pos", XMLTOK_POS },
+	{ "sblg-prev-base", XMLTOK_PREV_BASE },
+	{ "sblg-prev-stripbase", XMLTOK_PREV_STRIPBASE },
+	{ "sblg-prev-striplangbase", XMLTOK_PREV_STRIPLANGBASE },
+	{ "sblg-source", XMLTOK_SOURCE },
+	{ "sblg-stripbase", XMLTOK_STRIPBASE },
+	{ "sblg-striplangbase", XMLTOK_STRIPLANGBASE },
+	{ "sblg-tags", XMLTOK_TAGS },
+	{ "sblg-title", XMLTOK_TITLE },
+	{ "sblg-titletext", XMLTOK_TITLETEXT },
+	{ "sblg-url", XMLTOK_URL },
+};
+
+/*
+ * Key for bsearch(3) over xmlkeys: a name that's not nil-terminated.
+ */
+struct	xmlkeyq {
+	const char	*name;
+	size_t		 sz;
+};
+
+static int
+xmlkeycmp(const void *p1, const void *p2)
+{
+	const struct xmlkeyq *q = p1;
+	const struct xmlkey *k = p2;
+	int		 rc;
+
+	if (0 != (rc = strncmp(q->name, k->name, q->sz)))
+		return(rc);
+	return('\0' == k->name[q->sz] ? 0 : -1);
+}
+
+/*
+ * Look up the placeholder name "name" of length "sz".
+ * Unknown names are XMLTOK_NONE.
+ */
+static enum xmltokt
+xmlkey(const char *name, size_t sz)
+{
+	struct xmlkeyq	 q;
+	const struct xmlkey *k;
+
+	q.name = name;
+	q.sz = sz;
+	k = bsearch(&q, xmlkeys, sizeof(xmlkeys) / sizeof(xmlkeys[0]),
+		sizeof(struct xmlkey), xmlkeycmp);
+	return(NULL == k ? XMLTOK_NONE : k->type);
+}
+
+/*
+ * Scan the next token from "*sp", advancing it.
+ * A placeholder is ${name} or ${name|arg}; the argument is set as the
+ * token's string.
+ * A "${" without a closing brace is literal text.
+ * Returns zero at the end of the string.
+ */
+static int
+xmlnexttok(const char **sp, struct xmltok *tok)
+{
+	const char	*s = *sp, *cp, *end, *arg;
+	size_t		 sz;
+
+	if ('\0' == *s)
+		return(0);
+
+	if (NULL == (cp = strstr(s, "${")) ||
+	    NULL == (end = strchr(cp, '}'))) {
+		tok->type = XMLTOK_TEXT;
+		tok->str = s;
+		tok->sz = strlen(s);
+		*sp = s + tok->sz;
+		return(1);
+	} else if (cp > s) {
+		tok->type = XMLTOK_TEXT;
+		tok->str = s;
+		tok->sz = cp - s;
+		*sp = cp;
+		return(1);
+	}
+
+	s = cp + 2;
+	sz = end - s;
+	tok->str = NULL;
+	tok->sz = 0;
+
+	if (NULL != (arg = memchr(s, '|', sz))) {
+		sz = arg - s;
+		tok->str = ++arg;
+		tok->sz = end - arg;
+	}
+
+	tok->type = xmlkey(s, sz);
+	*sp = end + 1;
+	return(1);
+}
+
+/*
+ * Break the nil-terminated string "s" into tokens, appending them to
+ * "toks" of length "toksz".
+ * Unknown placeholders, which never print anything, are dropped.
+ * The tokens point into "s", which must outlive them.
  */
 void
-xmltextx(FILE *f, const XML_Char *s, const char *url, 
-	const struct article *arts, size_t artsz, size_t artpos)
+xmltok(const char *s, struct xmltok **toks, size_t *toksz)
 {
-	const char	*cp, *start, *end, *arg, *bufp;
-	char		 buf[32];
-	size_t		 sz, next, prev, argsz, i, asz;
+	struct xmltok	 tok;
 
-	if (NULL == s || '\0' == *s)
+	if (NULL == s)
 		return;
 
-	prev = (artpos + 1) % artsz;
-	next = artpos == 0 ? artsz - 1 : artpos - 1;
+	while (xmlnexttok(&s, &tok)) {
+		if (XMLTOK_NONE == tok.type)
+			continue;
+		*toks = xreallocarray(*toks, *toksz + 1, sizeof(struct xmltok));
+		(*toks)[(*toksz)++] = tok;
+	}
+}
 
-	/*
-	 * Check whether "_word", string length "_sz", is the same as
-	 * the value currently at "start".
-	 */
+/*
+ * Emit the token "tok" to "f".
+ * See xmltextx() for the remaining arguments.
+ */
+static void
+xmltokx(struct out *f, const struct xmltok *tok, const char *url, 
+	struct artset *set, const size_t *perm, size_t artpos,
+	const struct page *pg)
+{
+	const struct article *arts = set->arts, *art;
+	size_t		 i, prev, next, artsz = set->artsz;
 
-#define	STRCMP(_word, _sz) \
-	(sz == (_sz) && 0 == memcmp(start, (_word), (_sz)))
+	/* First those not of articles, as a page may have none. */
 
-	start = s;
-	while (NULL != (cp = strstr(start, "${"))) {
-		if (NULL == (end = strchr(cp, '}')))
-			break;
-		fprintf(f, "%.*s", (int)(cp - start), start);
-		start = cp + 2;
-		sz = end - start;
-		arg = NULL;
-		argsz = 0;
-		bufp = "";
-
-		if (NULL != (arg = memchr(start, '|', sz))) {
-			sz = arg - start;
-			arg++;
-			argsz = end - arg;
-		} 
-
-		/*
-		 * The following tags all dynamically construct a value
-		 * that we put into the "bufp" pointer, which defaults
-		 * to the empty string.
-		 */
-
-		if (STRCMP("sblg-date", 9)) {
-			strftime(buf, sizeof(buf), "%F", 
-				gmtime(&arts[artpos].time));
-			bufp = buf;
-		} else if (STRCMP("sblg-datetime", 13)) {
-			strftime(buf, sizeof(buf), "%FT%TZ", 
-				gmtime(&arts[artpos].time));
-			bufp = buf;
-		} else if (STRCMP("sblg-datetime-fmt", 17)) {
-			fmttime(buf, sizeof(buf), arg, argsz,
-				arts[artpos].isdatetime,
-				localtime(&arts[artpos].time));
-			bufp = buf;
-		} else if (STRCMP("sblg-pos", 8)) {
-			snprintf(buf, sizeof(buf), "%zu", artpos + 1);
-			bufp = buf;
-		} else if (STRCMP("sblg-get", 8))
-			for (i = 0; i < arts[artpos].setmapsz; i += 2) {
-				asz = strlen(arts[artpos].setmap[i]);
-				/* Ugly and slow, but effective. */
-				if (asz == argsz && 0 == memcmp
-				    (arts[artpos].setmap[i], 
-				     arg, argsz)) {
-					bufp = arts[artpos].setmap[i + 1];
-					break;
-				}
-			}
+	switch (tok->type) {
+	case (XMLTOK_TEXT):
+		out_write(f, tok->str, tok->sz);
+		return;
+	case (XMLTOK_PAGE):
+		out_putll(f, NULL == pg ? 1 : (long long)pg->num);
+		return;
+	case (XMLTOK_PAGE_NEXT):
+		if (NULL != pg && NULL != pg->next)
+			out_puts(f, pg->next);
+		return;
+	case (XMLTOK_PAGE_PREV):
+		if (NULL != pg && NULL != pg->prev)
+			out_puts(f, pg->prev);
+		return;
+	case (XMLTOK_PAGES):
+		out_putll(f, NULL == pg ? 1 : (long long)pg->max);
+		return;
+	case (XMLTOK_URL):
+		out_puts(f, NULL == url ? "" : url);
+		return;
+	default:
+		break;
+	}
+
+	if (artpos >= artsz)
+		return;
 
-		if (STRCMP("sblg-base", 9))
-			fputs(arts[artpos].base, f);
-		else if (STRCMP("sblg-get", 8))
-			fputs(bufp, f);
-		else if (STRCMP("sblg-tags", 9))
-			taglist(f, &arts[artpos], arg, argsz);
-		else if (STRCMP("sblg-stripbase", 14))
-			fputs(arts[artpos].stripbase, f);
-		else if (STRCMP("sblg-striplangbase", 18))
-			fputs(arts[artpos].striplangbase, f);
-		else if (STRCMP("sblg-first-base", 15))
-			fputs(arts[0].base, f);
-		else if (STRCMP("sblg-first-stripbase", 20))
-			fputs(arts[0].stripbase, f);
-		else if (STRCMP("sblg-first-striplangbase", 24))
-			fputs(arts[0].striplangbase, f);
-		else if (STRCMP("sblg-last-base", 14))
-			fputs(arts[artsz - 1].base, f);
-		else if (STRCMP("sblg-last-stripbase", 19))
-			fputs(arts[artsz - 1].stripbase, f);
-		else if (STRCMP("sblg-last-striplangbase", 23))
-			fputs(arts[artsz - 1].striplangbase, f);
-		else if (STRCMP("sblg-next-base", 14))
-			fputs(arts[next].base, f);
-		else if (STRCMP("sblg-next-stripbase", 19))
-			fputs(arts[next].stripbase, f);
-		else if (STRCMP("sblg-next-striplangbase", 23))
-			fputs(arts[next].striplangbase, f);
-		else if (STRCMP("sblg-prev-base", 14))
-			fputs(arts[prev].base, f);
-		else if (STRCMP("sblg-prev-stripbase", 19))
-			fputs(arts[prev].stripbase, f);
-		else if (STRCMP("sblg-prev-striplangbase", 23))
-			fputs(arts[prev].striplangbase, f);
-		else if (STRCMP("sblg-title", 10))
-			fputs(arts[artpos].title, f);
-		else if (STRCMP("sblg-url", 8))
-			fputs(NULL == url ? "" : url, f);
-		else if (STRCMP("sblg-titletext", 14))
-			fputs(arts[artpos].titletext, f);
-		else if (STRCMP("sblg-author", 11))
-			fputs(arts[artpos].author, f);
-		else if (STRCMP("sblg-authortext", 15))
-			fputs(arts[artpos].authortext, f);
-		else if (STRCMP("sblg-source", 11))
-			fputs(arts[artpos].src, f);
-		else if (STRCMP("sblg-date", 9))
-			fputs(bufp, f);
-		else if (STRCMP("sblg-datetime", 13))
-			fputs(bufp, f);
-		else if (STRCMP("sblg-datetime-fmt", 17))
-			fputs(bufp, f);
-		else if (STRCMP("sblg-pos", 8))
-			fputs(bufp, f);
-		else if (STRCMP("sblg-aside", 10))
-			fputs(arts[artpos].aside, f);
-		else if (STRCMP("sblg-asidetext", 14))
-			fputs(arts[artpos].asidetext, f);
-		else if (STRCMP("sblg-img", 8) &&
-		         NULL != arts[artpos].img)
-			fputs(arts[artpos].img, f);
-
-		start = end + 1;
+	art = &arts[perm[artpos]];
+	prev = perm[(artpos + 1) % artsz];
+	next = perm[artpos == 0 ? artsz - 1 : artpos - 1];
+
+	switch (tok->type) {
+	case (XMLTOK_ASIDE):
+		out_puts(f, art->aside);
+		break;
+	case (XMLTOK_ASIDETEXT):
+		if (NULL != art->asidetext)
+			out_puts(f, art->asidetext);
+		break;
+	case (XMLTOK_AUTHOR):
+		out_puts(f, art->author);
+		break;
+	case (XMLTOK_AUTHORTEXT):
+		if (NULL != art->authortext)
+			out_puts(f, art->authortext);
+		break;
+	case (XMLTOK_BASE):
+		out_puts(f, art->base);
+		break;
+	case (XMLTOK_DATE):
+		out_puts(f, artset_date(set, perm[artpos])->date);
+		break;
+	case (XMLTOK_DATETIME):
+		out_puts(f, artset_date(set, perm[artpos])->datetime);
+		break;
+	case (XMLTOK_DATETIME_FMT):
+		out_puts(f, artset_datefmt(set, 
+			perm[artpos], tok->str, tok->sz));
+		break;
+	case (XMLTOK_FIRST_BASE):
+		out_puts(f, arts[perm[0]].base);
+		break;
+	case (XMLTOK_FIRST_STRIPBASE):
+		out_puts(f, arts[perm[0]].stripbase);
+		break;
+	case (XMLTOK_FIRST_STRIPLANGBASE):
+		out_puts(f, arts[perm[0]].striplangbase);
+		break;
+	case (XMLTOK_GET):
+		/* Ugly and slow, but effective. */
+		for (i = 0; i < art->setmapsz; i += 2)
+			if (strlen(art->setmap[i]) == tok->sz &&
+			    0 == memcmp(art->setmap[i], 
+				    tok->str, tok->sz)) {
+				out_puts(f, art->setmap[i + 1]);
+				break;
+			}
+		break;
+	case (XMLTOK_IMG):
+		if (NULL != art->img)
+			out_puts(f, art->img);
+		break;
+	case (XMLTOK_LAST_BASE):
+		out_puts(f, arts[perm[artsz - 1]].base);
+		break;
+	case (XMLTOK_LAST_STRIPBASE):
+		out_puts(f, arts[perm[artsz - 1]].stripbase);
+		break;
+	case (XMLTOK_LAST_STRIPLANGBASE):
+		out_puts(f, arts[perm[artsz - 1]].striplangbase);
+		break;
+	case (XMLTOK_NEXT_BASE):
+		out_puts(f, arts[next].base);
+		break;
+	case (XMLTOK_NEXT_STRIPBASE):
+		out_puts(f, arts[next].stripbase);
+		break;
+	case (XMLTOK_NEXT_STRIPLANGBASE):
+		out_puts(f, arts[next].striplangbase);
+		break;
+	case (XMLTOK_POS):
+		out_putll(f, (long long)(artpos + 1));
+		break;
+	case (XMLTOK_PREV_BASE):
+		out_puts(f, arts[prev].base);
+		break;
+	case (XMLTOK_PREV_STRIPBASE):
+		out_puts(f, arts[prev].stripbase);
+		break;
+	case (XMLTOK_PREV_STRIPLANGBASE):
+		out_puts(f, arts[prev].striplangbase);
+		break;
+	case (XMLTOK_SOURCE):
+		out_puts(f, art->src);
+		break;
+	case (XMLTOK_STRIPBASE):
+		out_puts(f, art->stripbase);
+		break;
+	case (XMLTOK_STRIPLANGBASE):
+		out_puts(f, art->striplangbase);
+		break;
+	case (XMLTOK_TAGS):
+		taglist(f, art, tok->str, tok->sz);
+		break;
+	case (XMLTOK_TITLE):
+		out_puts(f, art->title);
+		break;
+	case (XMLTOK_TITLETEXT):
+		if (NULL != art->titletext)
+			out_puts(f, art->titletext);
+		break;
+	default:
+		break;
 	}
+}
+
+/*
+ * Like xmltextx(), but for the tokens "toks" of length "toksz" as
+ * prepared by xmltok().
+ */
+void
+xmltoksx(struct out *f, const struct xmltok *toks, size_t toksz, 
+	const char *url, struct artset *set, 
+	const size_t *perm, size_t artpos, const struct page *pg)
+{
+	size_t	 i;
 
-	fputs(start, f);
+	for (i = 0; i < toksz; i++)
+		xmltokx(f, &toks[i], url, set, perm, artpos, pg);
 }
 
 /*
- * Emits to "f" an XML element named "s" with NULL-terminated argument
- * list "atts" of key-value string pairs (libexpat style).
- * Passes all of the attribute values through xmltextx().
- * See xmltextx() for an explanation of the remaining variables.
+ * Given the nil-terminated string "s", emit all of its characters to
+ * "f" while substituting ${sblg-xxxxx} tags in the process.
+ * This uses the articles of "set" in the order "perm", currently at
+ * position "artpos" in that order.
+ * The "url" is the current file being written (naming "f"), and "pg"
+ * its page if paginated or NULL (as if the only page).
+ * FIXME: the contents written are not escaped in any way.
  */
 void
-xmlopensx(FILE *f, const XML_Char *s, 
-	const XML_Char **atts, const char *url, 
-	const struct article *art, size_t artsz, size_t artpos)
+xmltextx(struct out *f, const XML_Char *s, const char *url, 
+	struct artset *set, const size_t *perm, size_t artpos,
+	const struct page *pg)
 {
+	struct xmltok	 tok;
 
-	fputc('<', f);
-	fputs(s, f);
+	if (NULL == s)
+		return;
 
-	for ( ; NULL != *atts; atts += 2) {
-		fputc(' ', f);
-		fputs(atts[0], f);
-		fputs("=\"", f);
-		xmltextx(f, atts[1], url, art, artsz, artpos);
-		fputc('"', f);
-	}
-	if (xmlvoid(s))
-		fputs(" /", f);
-	fputc('>', f);
+	while (xmlnexttok(&s, &tok))
+		xmltokx(f, &tok, url, set, perm, artpos, pg);
 }
 
 /*
@@ -632,21 +912,21 @@ xmlopensx(FILE *f, const XML_Char *s,
  * "atts" of key-value string pairs (libexpat style).
  */
 void
-xmlopens(FILE *f, const XML_Char *s, const XML_Char **atts)
+xmlopens(struct out *f, const XML_Char *s, const XML_Char **atts)
 {
 
-	fputc('<', f);
-	fputs(s, f);
+	out_putc(f, '<');
+	out_puts(f, s);
 	for ( ; NULL != *atts; atts += 2) {
-		fputc(' ', f);
-		fputs(atts[0], f);
-		fputs("=\"", f);
+		out_putc(f, ' ');
+		out_puts(f, atts[0]);
+		out_puts(f, "=\"");
 		xmlescape(f, atts[1]);
-		fputc('"', f);
+		out_putc(f, '"');
 	}
 	if (xmlvoid(s))
-		fputs(" /", f);
-	fputc('>', f);
+		out_puts(f, " /");
+	out_putc(f, '>');
 }
 
 /*
@@ -733,8 +1013,14 @@ xmalloc(size_t sz)
 	return(p);
 }
 
+/*
+ * Set the key-value pair "key" and "val" in "map" of size "sz",
+ * replacing any prior value.
+ * If "a" is not NULL, the strings are allocated from it.
+ */
 void
-hashset(char ***map, size_t *sz, const char *key, const char *val)
+hashset(struct arena *a, char ***map, 
+	size_t *sz, const char *key, const char *val)
 {
 	size_t	 i;
 
@@ -745,14 +1031,22 @@ hashset(char ***map, size_t *sz, const char *key, const char *val)
 			break;
 
 	if (i < *sz) {
-		free((*map)[i + 1]);
-		(*map)[i + 1] = xstrdup(val);
+		if (NULL == a) {
+			free((*map)[i + 1]);
+			(*map)[i + 1] = xstrdup(val);
+		} else
+			(*map)[i + 1] = arena_strdup(a, val);
 		return;
 	}
 
 	*map = xreallocarray(*map, *sz + 2, sizeof(char *));
-	(*map)[*sz] = xstrdup(key);
-	(*map)[*sz + 1] = xstrdup(val);
+	if (NULL == a) {
+		(*map)[*sz] = xstrdup(key);
+		(*map)[*sz + 1] = xstrdup(val);
+	} else {
+		(*map)[*sz] = arena_strdup(a, key);
+		(*map)[*sz + 1] = arena_strdup(a, val);
+	}
 	(*sz) += 2;
 }
 
@@ -761,9 +1055,10 @@ hashset(char ***map, size_t *sz, const char *key, const char *val)
  * The input is a string of space-separated except for those with
  * backslash-escaped spaces.
  * Use this for data-sblg-navtags or data-sblg-tag.
+ * If "a" is not NULL, the tags are allocated from it.
  */
 void
-hashtag(char ***map, size_t *sz, const char *in)
+hashtag(struct arena *a, char ***map, size_t *sz, const char *in)
 {
 	char	*start, *end, *cur, *tofree;
 	size_t	 i;
@@ -800,7 +1095,8 @@ hashtag(char ***map, size_t *sz, const char *in)
 			continue;
 
 		*map = xreallocarray(*map, *sz + 1, sizeof(char *));
-		(*map)[*sz] = xstrdup(start);
+		(*map)[*sz] = NULL == a ? 
+			xstrdup(start) : arena_strdup(a, start);
 		(*sz)++;
 	}
 